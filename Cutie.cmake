@@ -18,16 +18,97 @@
 #          include(${CUTIE_DIR}/Cutie.cmake)
 #   4. Call Cutie's add_cutie_test_target for each test you have. For example:
 #          add_cutie_test_target(TEST test/a.cpp SOURCES src/a.c src/b.c)
+#      Or, bundle many tests into one executable using add_cutie_test_bundle. For example:
+#          add_cutie_test_bundle(NAME module_tests TESTS test/a.cpp test/b.cpp SOURCES src/a.c src/b.c)
 #   5. Call Cutie's add_cutie_all_tests_target to add the `all_tests` target. This is optional.
 #   6. Call Cutie's add_cutie_coverage_targets to add the `coverage` and `clean_coverage` targets. This is optional.
+#   7. Call Cutie's add_cutie_changed_tests_target to add the `changed_tests` target. This is optional.
+#   8. Call Cutie's add_cutie_benchmark_target for each benchmark you have, and add_cutie_all_benchmarks_target
+#      to add the `all_benchmarks` target. This is optional.
+#
+# Using a prebuilt Cutie
+# ~~~~~~~~~~~~~~~~~~~~~~
+# Instead of steps 2 and 3, which build Cutie's dependencies in every project and every clean build,
+# build and install a Cutie package once per toolchain (see package/CMakeLists.txt), and find it:
+#     find_package(Cutie REQUIRED)
+# The package includes Cutie.cmake, and its tests link the prebuilt libraries of the imported Cutie::cutie target.
 #
 # Running Tests
 # ~~~~~~~~~~~~~
 # After integrating Cutie, run all tests using the `tests` target.
+# The `all_tests` target runs the tests in parallel, as many at once as the CUTIE_TEST_JOBS variable
+# (which defaults to the number of cores). CTest remembers how long each test took, and starts the longest ones first.
+# A large test file can be split into several CTest tests using the SHARDS keyword of add_cutie_test_target.
+# Each shard runs a part of the file's test cases, using GoogleTest's GTEST_TOTAL_SHARDS and GTEST_SHARD_INDEX.
+#
+# Test Times
+# ~~~~~~~~~~
+# The `all_tests` target also records the wall time, CPU time and peak memory (RSS) of each test case, into
+# ${PROJECT_BINARY_DIR}/test_times.jsonl, and compares them to the baseline in CUTIE_TEST_TIMES_BASELINE.
+# A test case whose wall time grew by more than CUTIE_TEST_TIME_THRESHOLD percent is reported as a regression,
+# which fails `all_tests` if CUTIE_TEST_TIME_REGRESSION is FAIL, and only warns if it's WARN (the default).
+# Test cases shorter than CUTIE_TEST_TIME_MIN milliseconds in the baseline are too noisy to compare.
+# The `update_test_times_baseline` target stores the latest times as the new baseline. For example:
+#     cmake --build . --target all_tests update_test_times_baseline    # Once, on a known good revision
+#     cmake --build . --target all_tests                               # Later, to compare to it
+# Tests run in parallel compete for the cores, so set CUTIE_TEST_JOBS to 1 for steadier times.
+# Comparing to the baseline requires CMake 3.19 or newer.
+#
+# Fork Server
+# ~~~~~~~~~~~
+# Each test executable is loaded, and initializes its static objects, every time CTest runs it.
+# Set the CUTIE_FORK_SERVER option to link the tests with a fork server instead of GoogleMock's main().
+# It does the above once, then runs each selected test case in a child forked from that point, one at a time,
+# so hooks, mocks and other global state left behind by a test never reach the next one, and a crash fails
+# only the test that crashed. For example:
+#     set(CUTIE_FORK_SERVER ON)
+#     include(${CUTIE_DIR}/Cutie.cmake)
+# Set CUTIE_FORK_SERVER_ISOLATION to `suite` to fork a child per test suite instead, so the tests of a suite
+# share SetUpTestSuite(). Shards and bundled tests are forked the same way, for the test cases they run.
+# At runtime, set the CUTIE_FORK_SERVER environment variable to `test`, `suite` or `off` to override it,
+# for example `off` to debug a test in a single process.
+# Tests run with --gtest_list_tests or --gtest_output run in a single process, as the children's reports
+# would overwrite each other, and the server prints a notice when --gtest_output turns isolation off.
+# Static initialization must not start threads, as only the forking thread exists in the children.
+#
+# Call Statistics
+# ~~~~~~~~~~~~~~~
+# Set the CUTIE_CALL_STATISTICS option to find the mocks and hooks a slow test spends its time in.
+# Every call to a mock, and to a hook installed with INSTALL_HOOK, is then counted and timed, including the time
+# spent in the original function through CALL_ORIGINAL (or by a recording). At the end of each test, its busiest
+# functions are printed, and when the tests end, a table of all of them, sorted by the time spent in them.
+# The table is also written as JSON to <test>.<pid>.call_statistics.json in the working directory, or to the path
+# in the CUTIE_CALL_STATISTICS_JSON environment variable, where %p is replaced by the pid. Every process writes its
+# own file, so the children of the fork server and parallel shards don't overwrite each other. To get the totals
+# of a run, sum the calls and times of each function over its files. The report is made by test executables that
+# include mock.hpp; a test using only hook.hpp should include inc/call_statistics_listener.hpp too. For example:
+#     set(CUTIE_CALL_STATISTICS ON)
+#     include(${CUTIE_DIR}/Cutie.cmake)
+# It's off by default, as timing every hooked call would skew benchmarks.
+#
+# Linker Wrapping
+# ~~~~~~~~~~~~~~~
+# Functions that are hooked or mocked in nearly every test can be wrapped by the linker instead of patched at
+# runtime, by listing them after the WRAP keyword of add_cutie_test_target (or add_cutie_test_bundle). For example:
+#     add_cutie_test_target(TEST test/a.cpp SOURCES src/a.c WRAP fopen fclose)
+# The test is linked with -Wl,--wrap for each of them, and calls to them jump through a pointer, so installing
+# a hook or a mock is a single store to it, with no code patching. Hooks and mocks are declared as usual.
+# Only calls from the test's own object files are wrapped, not calls from shared libraries or calls within the
+# source file that defines the function. C++ functions must be listed by their mangled names.
 #
 # Collecting Coverage
 # ~~~~~~~~~~~~~~~~~~~
 # After integrating Cutie, run all tests and collect coverage using the `coverage` target.
+# Tests are built without coverage instrumentation, so they run faster and don't write .gcda files.
+# The `coverage` target builds and runs an instrumented copy of each test, named <test>_coverage.
+# Set the CUTIE_COVERAGE option to instrument the tests themselves instead (and have `coverage` run them).
+# Tests added with the NO_COVERAGE keyword are never instrumented.
+# The instrumented copies run in parallel, each writing its coverage data to a directory of its own
+# under ${PROJECT_BINARY_DIR}/coverage_data. The data of each test is then captured separately, so build
+# the `coverage` target with -j to capture in parallel too. For example:
+#     cmake --build . --target coverage -j 8
+# The report is built by lcov by default. Set CUTIE_COVERAGE_BACKEND to gcovr to use gcovr instead,
+# and set CUTIE_COVERAGE_LLVM_COV if the tests are built with Clang.
 # The coverage will be collected to ${PROJECT_BINARY_DIR}/coverage.
 # The coverage will be written as a series of HTML pages for your convenience.
 # To view the coverage report, open ${PROJECT_BINARY_DIR}/coverage/index.html in your favorite web browser.
@@ -36,9 +117,68 @@
 # ~~~~~~~~~~~~~~~~~
 # To clean coverage data, use the `clean_coverage` target.
 #
-cmake_minimum_required(VERSION 3.10)
+# Running Changed Tests
+# ~~~~~~~~~~~~~~~~~~~~~
+# The `changed_tests` target runs only the tests affected by the files changed since the last commit
+# (according to `git diff`). A test is affected if one of its files changed, if one of the headers its files
+# include changed, or if it covered a changed file in the last run of the `coverage` target.
+# Changes to CMake files run all tests.
+#
+# Benchmarks
+# ~~~~~~~~~~
+# Benchmarks are written with Google Benchmark, and can use hooks and mocks just like tests, to replace slow
+# dependencies (disk, network, clocks) around the benchmarked code. Add each benchmark file using
+# add_cutie_benchmark_target. For example:
+#     add_cutie_benchmark_target(BENCHMARK bench/a.cpp SOURCES src/a.c)
+# Then add the `all_benchmarks` target using add_cutie_all_benchmarks_target. It runs all benchmarks, writes their
+# results to ${PROJECT_BINARY_DIR}/benchmarks/<benchmark>.json, and compares them to the results stored in
+# CUTIE_BENCHMARK_BASELINE_DIR. It fails if a benchmark got slower by more than CUTIE_BENCHMARK_THRESHOLD percent.
+# The `update_benchmark_baseline` target stores the latest results as the new baseline.
+# Google Benchmark is taken from ${CUTIE_DIR}/benchmark if it's there, and found using find_package otherwise.
+# Comparing to the baseline requires CMake 3.19 or newer.
+#
+# Precompiled Headers
+# ~~~~~~~~~~~~~~~~~~~
+# Most of a test's compilation time is spent parsing mock.hpp and hook.hpp (and through them, GMock).
+# Set the CUTIE_PRECOMPILED_HEADERS option to precompile them once, into the `cutie_pch` object library
+# (and `cutie_coverage_pch` for instrumented tests),
+# and reuse the result in every test target. For example:
+#     set(CUTIE_PRECOMPILED_HEADERS ON)
+#     include(${CUTIE_DIR}/Cutie.cmake)
+# The headers are then included implicitly in every C++ file of the tests, before any other header.
+#
+# Cutie requires CMake 3.16 or newer, for precompiled headers and unity builds.
+cmake_minimum_required(VERSION 3.16)
 set(CMAKE_CXX_STANDARD 17)
 include(CTest)
+include(GoogleTest)
+include(ProcessorCount)
+option(CUTIE_PRECOMPILED_HEADERS "Precompile mock.hpp and hook.hpp once for all tests" OFF)
+ProcessorCount(CUTIE_PROCESSOR_COUNT)
+if (CUTIE_PROCESSOR_COUNT EQUAL 0)
+    set(CUTIE_PROCESSOR_COUNT 1)
+endif ()
+set(CUTIE_TEST_JOBS ${CUTIE_PROCESSOR_COUNT} CACHE STRING "The number of tests the all_tests target runs in parallel")
+set(CUTIE_COVERAGE_BACKEND lcov CACHE STRING "The tool that builds the coverage report: lcov or gcovr")
+set_property(CACHE CUTIE_COVERAGE_BACKEND PROPERTY STRINGS lcov gcovr)
+option(CUTIE_COVERAGE_LLVM_COV "Read coverage data with 'llvm-cov gcov' instead of gcov, for tests built with Clang" OFF)
+set(CUTIE_BENCHMARK_BASELINE_DIR ${PROJECT_SOURCE_DIR}/benchmarks CACHE PATH
+        "The directory of the benchmark results the all_benchmarks target compares to")
+set(CUTIE_BENCHMARK_THRESHOLD 10 CACHE STRING
+        "The slowdown of a benchmark, in percent, the all_benchmarks target reports as a regression")
+set(CUTIE_TEST_TIMES_BASELINE ${PROJECT_BINARY_DIR}/test_times_baseline.jsonl CACHE FILEPATH
+        "The test times the all_tests target compares to")
+set(CUTIE_TEST_TIME_THRESHOLD 20 CACHE STRING
+        "The slowdown of a test case, in percent, the all_tests target reports as a regression")
+set(CUTIE_TEST_TIME_MIN 50 CACHE STRING
+        "The shortest baseline wall time of a test case, in milliseconds, the all_tests target compares")
+set(CUTIE_TEST_TIME_REGRESSION WARN CACHE STRING "Whether regressions of test times fail the all_tests target")
+set_property(CACHE CUTIE_TEST_TIME_REGRESSION PROPERTY STRINGS WARN FAIL)
+option(CUTIE_FORK_SERVER "Run each test case in a child forked after static initialization" OFF)
+set(CUTIE_FORK_SERVER_ISOLATION test CACHE STRING "What each child of the fork server runs: a test case or a test suite")
+set_property(CACHE CUTIE_FORK_SERVER_ISOLATION PROPERTY STRINGS test suite)
+option(CUTIE_CALL_STATISTICS "Count and time the calls to mocks and hooks, and report them when the tests end" OFF)
+option(CUTIE_COVERAGE "Instrument all tests for coverage, instead of building instrumented copies for the coverage target" OFF)
 
 ## Functions
 function(verify_variable variable_name)
@@ -56,16 +196,14 @@ endif ()
 
 ## Global Variables
 set(TEST_TARGETS)
+set(BENCHMARK_TARGETS)
+
+# Compiles Cutie's dependencies and defines the settings targets shared by all tests, on first call
+function(add_cutie_dependencies)
+    if (TARGET cutie)
+        return()
+    endif ()
 
-# Defines a new target to run a single test file
-# Usage:
-#     add_cutie_test_target(TEST test [SOURCES sources...])
-#     'test' is the test file that should be executed
-#     'sources' is an optional list of source files that are required for the test
-#
-# Example:
-#     add_cutie_test_target(TEST test/a.cpp SOURCES src/a.c src/b.c)
-function(add_cutie_test_target)
     ## Dependencies directories
     set(GOOGLETEST_DIR ${CUTIE_DIR}/googletest)
     set(SUBHOOK_DIR ${CUTIE_DIR}/subhook)
@@ -75,59 +213,554 @@ function(add_cutie_test_target)
     set(COVERAGE_FLAGS -fprofile-arcs -ftest-coverage --coverage)
     set(CMOCK_LINKER_FLAGS "-rdynamic -Wl,--no-as-needed -ldl")
 
-    ## Compiling dependencies
-    if (NOT DEFINED _CUTIE_DEPENDENCIES_COMPILED)
+    # The settings shared by tests and benchmarks, without a main() function
+    add_library(cutie_base INTERFACE)
+    if (TARGET Cutie::cutie)
+        # Prebuilt by an installed Cutie package, found by find_package(Cutie) (see package/CMakeLists.txt)
+        target_include_directories(cutie_base INTERFACE ${CUTIE_DIR})
+        target_link_libraries(cutie_base INTERFACE Cutie::cutie)
+        set(GMOCK_MAIN Cutie::gmock_main)
+    else ()
+        ## Compiling dependencies
         set(INSTALL_GTEST OFF)
-        add_subdirectory(${GOOGLETEST_DIR} EXCLUDE_FROM_ALL)
-        set(SUBHOOK_STATIC ON)
-        set(SUBHOOK_TESTS OFF)
-        add_subdirectory(${SUBHOOK_DIR} EXCLUDE_FROM_ALL)
-        set(_CUTIE_DEPENDENCIES_COMPILED 1 PARENT_SCOPE)
+        add_subdirectory(${GOOGLETEST_DIR} ${PROJECT_BINARY_DIR}/cutie/googletest EXCLUDE_FROM_ALL)
+        target_include_directories(cutie_base INTERFACE
+                ${CUTIE_DIR}
+                ${GOOGLETEST_DIR}/googlemock/include
+                ${GOOGLETEST_DIR}/googletest/include
+                ${CMOCK_DIR}/include)
+        target_link_libraries(cutie_base INTERFACE gmock ${CMOCK_LINKER_FLAGS})
+        # SubHook supports only x86, on AArch64 Cutie builds the trampolines itself (see inc/subhook_arm64.hpp)
+        if (NOT CMAKE_SYSTEM_PROCESSOR MATCHES "^(aarch64|arm64|ARM64)$")
+            set(SUBHOOK_STATIC ON)
+            set(SUBHOOK_TESTS OFF)
+            add_subdirectory(${SUBHOOK_DIR} ${PROJECT_BINARY_DIR}/cutie/subhook EXCLUDE_FROM_ALL)
+            target_include_directories(cutie_base INTERFACE ${SUBHOOK_DIR})
+            target_link_libraries(cutie_base INTERFACE subhook)
+        endif ()
+        set(GMOCK_MAIN gmock_main)
+    endif ()
+
+    if (CUTIE_CALL_STATISTICS)
+        target_compile_definitions(cutie_base INTERFACE CUTIE_CALL_STATISTICS)
+    endif ()
+
+    # The fork server replaces GoogleMock's main(). It's compiled once, without coverage instrumentation.
+    if (CUTIE_FORK_SERVER)
+        add_library(cutie_fork_server STATIC EXCLUDE_FROM_ALL ${CUTIE_DIR}/inc/fork_server_main.cpp)
+        target_link_libraries(cutie_fork_server PUBLIC cutie_base)
+        if (CUTIE_FORK_SERVER_ISOLATION STREQUAL "suite")
+            target_compile_definitions(cutie_fork_server PRIVATE CUTIE_FORK_PER_SUITE)
+        endif ()
+        set(GMOCK_MAIN cutie_fork_server)
+    endif ()
+
+    # The settings shared by all tests
+    add_library(cutie INTERFACE)
+    target_link_libraries(cutie INTERFACE cutie_base ${GMOCK_MAIN})
+
+    # The settings of tests instrumented for coverage
+    add_library(cutie_coverage INTERFACE)
+    target_compile_options(cutie_coverage INTERFACE ${COVERAGE_FLAGS})
+    target_link_libraries(cutie_coverage INTERFACE cutie ${COVERAGE_FLAGS})
+
+    # The precompiled headers are built once per settings target, as they must be compiled with the same flags
+    if (CUTIE_PRECOMPILED_HEADERS)
+        add_cutie_pch_target(cutie)
+        add_cutie_pch_target(cutie_coverage)
+    endif ()
+endfunction()
+
+# Defines an executable built with one of Cutie's settings targets (`cutie` or `cutie_coverage`)
+# Usage:
+#     add_cutie_executable(target settings [EXCLUDE_FROM_ALL] [UNITY] SOURCES sources...)
+#     'UNITY' compiles the sources in batches, as a unity build
+function(add_cutie_executable target_name settings_target)
+    cmake_parse_arguments(PARSE_ARGV 2 EXECUTABLE "EXCLUDE_FROM_ALL;UNITY" "" "SOURCES;WRAP")
+    if (EXECUTABLE_WRAP)
+        # The dispatchers of the functions wrapped by the linker (see inc/link_wrap.hpp)
+        set(WRAP_SOURCE ${PROJECT_BINARY_DIR}/cutie_wrap/${target_name}.cpp)
+        set(WRAP_CONTENT "// Generated by Cutie.cmake, for the functions wrapped by the linker\n")
+        string(APPEND WRAP_CONTENT "#include \"inc/link_wrap.hpp\"\n\n")
+        foreach (WRAPPED ${EXECUTABLE_WRAP})
+            string(APPEND WRAP_CONTENT "CUTIE_WRAP(${WRAPPED});\n")
+        endforeach ()
+        file(GENERATE OUTPUT ${WRAP_SOURCE} CONTENT "${WRAP_CONTENT}")
+        set_source_files_properties(${WRAP_SOURCE} PROPERTIES SKIP_UNITY_BUILD_INCLUSION ON)
+        list(APPEND EXECUTABLE_SOURCES ${WRAP_SOURCE})
+    endif ()
+    if (EXECUTABLE_EXCLUDE_FROM_ALL)
+        add_executable(${target_name} EXCLUDE_FROM_ALL ${EXECUTABLE_SOURCES})
+    else ()
+        add_executable(${target_name} ${EXECUTABLE_SOURCES})
     endif ()
+    foreach (WRAPPED ${EXECUTABLE_WRAP})
+        target_link_libraries(${target_name} "-Wl,--wrap=${WRAPPED}")
+    endforeach ()
+    if (EXECUTABLE_UNITY)
+        set_target_properties(${target_name} PROPERTIES UNITY_BUILD ON)
+    endif ()
+    if (CUTIE_PRECOMPILED_HEADERS)
+        target_link_libraries(${target_name} ${settings_target}_pch)
+        target_precompile_headers(${target_name} REUSE_FROM ${settings_target}_pch)
+        # The headers are precompiled for C++ only
+        set(C_SOURCES ${EXECUTABLE_SOURCES})
+        list(FILTER C_SOURCES INCLUDE REGEX "\\.[cC]$")
+        if (C_SOURCES)
+            set_source_files_properties(${C_SOURCES} PROPERTIES SKIP_PRECOMPILE_HEADERS ON)
+        endif ()
+    else ()
+        target_link_libraries(${target_name} ${settings_target})
+    endif ()
+endfunction()
 
-    ## Define the test target
-    cmake_parse_arguments(PARSE_ARGV 0 TEST "" TEST SOURCES)
+# Registers an executable with CTest, as a single test named <test>, or split into shards named <test>_shard<index>
+# Each shard runs a part of the test cases, using GoogleTest's GTEST_TOTAL_SHARDS and GTEST_SHARD_INDEX.
+# Usage:
+#     add_cutie_sharded_test(test target shards tests_variable [CONFIGURATIONS configurations...])
+#     'tests_variable' is set to the names of the registered tests in the calling scope
+function(add_cutie_sharded_test test_name target_name shards tests_variable)
+    set(TESTS)
+    if (NOT shards OR shards LESS 2)
+        add_test(NAME ${test_name} COMMAND ${target_name} ${ARGN})
+        list(APPEND TESTS ${test_name})
+    else ()
+        math(EXPR LAST_SHARD "${shards} - 1")
+        foreach (SHARD RANGE ${LAST_SHARD})
+            add_test(NAME ${test_name}_shard${SHARD} COMMAND ${target_name} ${ARGN})
+            set_property(TEST ${test_name}_shard${SHARD} APPEND PROPERTY
+                    ENVIRONMENT "GTEST_TOTAL_SHARDS=${shards}" "GTEST_SHARD_INDEX=${SHARD}")
+            list(APPEND TESTS ${test_name}_shard${SHARD})
+        endforeach ()
+    endif ()
+    set(${tests_variable} ${TESTS} PARENT_SCOPE)
+endfunction()
+
+# Defines a test executable, and unless CUTIE_COVERAGE is ON, its instrumented <target>_coverage copy
+# The test itself isn't registered with CTest. The copy is, and is appended to COVERAGE_TEST_TARGETS in the calling scope.
+# Usage:
+#     add_cutie_test_executables(target [NO_COVERAGE] [UNITY] [SHARDS shards] SOURCES sources...)
+function(add_cutie_test_executables target_name)
+    cmake_parse_arguments(PARSE_ARGV 1 EXECUTABLES "NO_COVERAGE;UNITY" SHARDS "SOURCES;WRAP")
+    set(EXECUTABLE_OPTIONS)
+    if (EXECUTABLES_UNITY)
+        set(EXECUTABLE_OPTIONS UNITY)
+    endif ()
+    if (EXECUTABLES_WRAP)
+        list(APPEND EXECUTABLE_OPTIONS WRAP ${EXECUTABLES_WRAP})
+    endif ()
+    if (CUTIE_COVERAGE AND NOT EXECUTABLES_NO_COVERAGE)
+        add_cutie_executable(${target_name} cutie_coverage ${EXECUTABLE_OPTIONS} SOURCES ${EXECUTABLES_SOURCES})
+    else ()
+        add_cutie_executable(${target_name} cutie ${EXECUTABLE_OPTIONS} SOURCES ${EXECUTABLES_SOURCES})
+        if (NOT EXECUTABLES_NO_COVERAGE)
+            # Only run by the `coverage` target, as plain ctest skips tests restricted to a configuration
+            add_cutie_executable(${target_name}_coverage cutie_coverage EXCLUDE_FROM_ALL ${EXECUTABLE_OPTIONS}
+                    SOURCES ${EXECUTABLES_SOURCES})
+            add_cutie_sharded_test(${target_name}_coverage ${target_name}_coverage "${EXECUTABLES_SHARDS}" TESTS
+                    CONFIGURATIONS Coverage)
+            # Each test writes its coverage data to a directory of its own, mirroring the build directory
+            string(REGEX MATCHALL "[^/]+" BUILD_DIR_COMPONENTS ${PROJECT_BINARY_DIR})
+            list(LENGTH BUILD_DIR_COMPONENTS BUILD_DIR_DEPTH)
+            foreach (TEST_NAME ${TESTS})
+                set_property(TEST ${TEST_NAME} PROPERTY LABELS cutie_coverage)
+                set_property(TEST ${TEST_NAME} APPEND PROPERTY ENVIRONMENT
+                        "GCOV_PREFIX=${PROJECT_BINARY_DIR}/coverage_data/${TEST_NAME}"
+                        "GCOV_PREFIX_STRIP=${BUILD_DIR_DEPTH}")
+            endforeach ()
+            set_property(TARGET ${target_name}_coverage PROPERTY CUTIE_COVERAGE_TESTS ${TESTS})
+            set_property(TARGET ${target_name}_coverage PROPERTY CUTIE_TESTED_TARGET ${target_name})
+            set(COVERAGE_TEST_TARGETS ${COVERAGE_TEST_TARGETS} ${target_name}_coverage PARENT_SCOPE)
+        endif ()
+    endif ()
+endfunction()
+
+# Defines the object library that precompiles Cutie's headers with the flags of a settings target
+# The library is named after the settings target, with a `_pch` suffix
+function(add_cutie_pch_target settings_target)
+    get_filename_component(CUTIE_ABSOLUTE_DIR ${CUTIE_DIR} ABSOLUTE)
+    set(CUTIE_PCH_SOURCE ${PROJECT_BINARY_DIR}/cutie_pch.cpp)
+    if (NOT EXISTS ${CUTIE_PCH_SOURCE})
+        file(WRITE ${CUTIE_PCH_SOURCE} "// Generated by Cutie.cmake, for building the precompiled headers\n")
+    endif ()
+    add_library(${settings_target}_pch OBJECT ${CUTIE_PCH_SOURCE})
+    # Built only if a test uses it
+    set_target_properties(${settings_target}_pch PROPERTIES EXCLUDE_FROM_ALL ON)
+    target_link_libraries(${settings_target}_pch PUBLIC ${settings_target})
+    target_precompile_headers(${settings_target}_pch PUBLIC
+            $<$<COMPILE_LANGUAGE:CXX>:${CUTIE_ABSOLUTE_DIR}/mock.hpp>
+            $<$<COMPILE_LANGUAGE:CXX>:${CUTIE_ABSOLUTE_DIR}/hook.hpp>)
+endfunction()
+
+# Defines a new target to run a single test file
+# Usage:
+#     add_cutie_test_target(TEST test [SOURCES sources...] [SHARDS shards] [WRAP functions...] [NO_COVERAGE])
+#     'test' is the test file that should be executed
+#     'sources' is an optional list of source files that are required for the test
+#     'shards' is the number of CTest tests the file is split into, named <test>_shard<index>. Defaults to 1.
+#     'functions' is an optional list of functions wrapped by the linker (see Linker Wrapping)
+#     'NO_COVERAGE' excludes the test from coverage, so it's never instrumented
+#
+# Unless CUTIE_COVERAGE is ON, the test is built without coverage instrumentation.
+# An instrumented copy of it, named <test>_coverage, is built and run only by the `coverage` target.
+#
+# Example:
+#     add_cutie_test_target(TEST test/a.cpp SOURCES src/a.c src/b.c)
+function(add_cutie_test_target)
+    add_cutie_dependencies()
+    cmake_parse_arguments(PARSE_ARGV 0 TEST "NO_COVERAGE" "TEST;SHARDS" "SOURCES;WRAP")
     get_filename_component(TEST_NAME ${TEST_TEST} NAME_WE)
-    add_executable(${TEST_NAME} ${TEST_TEST} ${TEST_SOURCES})
-    target_include_directories(${TEST_NAME} PUBLIC
-            ${CUTIE_DIR}
-            ${GOOGLETEST_DIR}/googlemock/include
-            ${GOOGLETEST_DIR}/googletest/include
-            ${CMOCK_DIR}/include
-            ${SUBHOOK_DIR})
-    target_compile_options(${TEST_NAME} PUBLIC ${COVERAGE_FLAGS})
-    target_link_libraries(${TEST_NAME} gmock_main subhook ${CMOCK_LINKER_FLAGS} ${COVERAGE_FLAGS})
+    set(TEST_OPTIONS)
+    if (TEST_NO_COVERAGE)
+        set(TEST_OPTIONS NO_COVERAGE)
+    endif ()
+    if (TEST_WRAP)
+        list(APPEND TEST_OPTIONS WRAP ${TEST_WRAP})
+    endif ()
+    add_cutie_test_executables(${TEST_NAME} ${TEST_OPTIONS} SHARDS "${TEST_SHARDS}" SOURCES ${TEST_TEST} ${TEST_SOURCES})
+    set(COVERAGE_TEST_TARGETS ${COVERAGE_TEST_TARGETS} PARENT_SCOPE)
     set(TEST_TARGETS ${TEST_TARGETS} ${TEST_NAME} PARENT_SCOPE)
-    add_test(NAME ${TEST_NAME} COMMAND ${TEST_NAME})
+    add_cutie_sharded_test(${TEST_NAME} ${TEST_NAME} "${TEST_SHARDS}" TESTS)
+endfunction()
+
+# Defines a new target that runs many test files from a single executable
+# Linking one executable instead of one per test file saves link time, and each test case is still
+# registered with CTest on its own, as <name>.<suite>.<test>.
+# Usage:
+#     add_cutie_test_bundle(NAME name TESTS tests... [SOURCES sources...] [WRAP functions...] [UNITY] [NO_COVERAGE])
+#     'name' is the name of the executable
+#     'tests' is the list of test files to bundle
+#     'sources' is an optional list of source files that are required for the tests. Each is compiled once.
+#     'functions' is an optional list of functions wrapped by the linker (see Linker Wrapping)
+#     'UNITY' compiles the test files in batches, as a unity build.
+#         The bundled files must then not declare the same mocks, hooks or test names.
+#         The sources are still compiled one by one.
+#     'NO_COVERAGE' excludes the bundle from coverage, so it's never instrumented
+#
+# Example:
+#     add_cutie_test_bundle(NAME module_tests TESTS test/a.cpp test/b.cpp SOURCES src/a.c src/b.c)
+function(add_cutie_test_bundle)
+    add_cutie_dependencies()
+    cmake_parse_arguments(PARSE_ARGV 0 BUNDLE "NO_COVERAGE;UNITY" NAME "TESTS;SOURCES;WRAP")
+    verify_variable(BUNDLE_NAME)
+    verify_variable(BUNDLE_TESTS)
+    set(BUNDLE_OPTIONS)
+    if (BUNDLE_NO_COVERAGE)
+        list(APPEND BUNDLE_OPTIONS NO_COVERAGE)
+    endif ()
+    if (BUNDLE_WRAP)
+        list(APPEND BUNDLE_OPTIONS WRAP ${BUNDLE_WRAP})
+    endif ()
+    if (BUNDLE_UNITY)
+        list(APPEND BUNDLE_OPTIONS UNITY)
+        # Only the test files are batched. Merging the tested sources would let the compiler optimize calls
+        # between functions of the same file, which breaks hooks on them.
+        if (BUNDLE_SOURCES)
+            set_source_files_properties(${BUNDLE_SOURCES} PROPERTIES SKIP_UNITY_BUILD_INCLUSION ON)
+        endif ()
+    endif ()
+    add_cutie_test_executables(${BUNDLE_NAME} ${BUNDLE_OPTIONS} SOURCES ${BUNDLE_TESTS} ${BUNDLE_SOURCES})
+    set(COVERAGE_TEST_TARGETS ${COVERAGE_TEST_TARGETS} PARENT_SCOPE)
+    set(TEST_TARGETS ${TEST_TARGETS} ${BUNDLE_NAME} PARENT_SCOPE)
+    gtest_discover_tests(${BUNDLE_NAME} TEST_PREFIX ${BUNDLE_NAME}.)
+endfunction()
+
+# Finds Google Benchmark and defines the settings target shared by all benchmarks, on first call
+function(add_cutie_benchmark_dependencies)
+    add_cutie_dependencies()
+    if (TARGET cutie_benchmark)
+        return()
+    endif ()
+
+    set(BENCHMARK_DIR ${CUTIE_DIR}/benchmark)
+    if (EXISTS ${BENCHMARK_DIR}/CMakeLists.txt)
+        set(BENCHMARK_ENABLE_TESTING OFF)
+        set(BENCHMARK_ENABLE_INSTALL OFF)
+        set(BENCHMARK_ENABLE_GTEST_TESTS OFF)
+        add_subdirectory(${BENCHMARK_DIR} ${PROJECT_BINARY_DIR}/cutie/benchmark EXCLUDE_FROM_ALL)
+    elseif (NOT TARGET benchmark::benchmark_main)
+        find_package(benchmark REQUIRED)
+    endif ()
+
+    # The settings shared by all benchmarks. Benchmarks aren't instrumented for coverage.
+    add_library(cutie_benchmark INTERFACE)
+    target_link_libraries(cutie_benchmark INTERFACE cutie_base benchmark::benchmark_main)
+    if (CUTIE_PRECOMPILED_HEADERS)
+        add_cutie_pch_target(cutie_benchmark)
+    endif ()
+endfunction()
+
+# Defines a new target to run a single benchmark file, written with Google Benchmark
+# The benchmark isn't registered with CTest. It's run by the `all_benchmarks` target, or directly.
+# Usage:
+#     add_cutie_benchmark_target(BENCHMARK benchmark [SOURCES sources...])
+#     'benchmark' is the benchmark file that should be executed
+#     'sources' is an optional list of source files that are required for the benchmark
+#
+# Example:
+#     add_cutie_benchmark_target(BENCHMARK bench/a.cpp SOURCES src/a.c src/b.c)
+function(add_cutie_benchmark_target)
+    add_cutie_benchmark_dependencies()
+    cmake_parse_arguments(PARSE_ARGV 0 BENCHMARK "" BENCHMARK SOURCES)
+    verify_variable(BENCHMARK_BENCHMARK)
+    get_filename_component(BENCHMARK_NAME ${BENCHMARK_BENCHMARK} NAME_WE)
+    add_cutie_executable(${BENCHMARK_NAME} cutie_benchmark SOURCES ${BENCHMARK_BENCHMARK} ${BENCHMARK_SOURCES})
+    set(BENCHMARK_TARGETS ${BENCHMARK_TARGETS} ${BENCHMARK_NAME} PARENT_SCOPE)
+endfunction()
+
+# Defines the `all_benchmarks` target that runs all benchmarks added with add_cutie_benchmark_target(),
+# and the `update_benchmark_baseline` target that stores their latest results as the baseline
+# Each benchmark writes its results to ${PROJECT_BINARY_DIR}/benchmarks/<benchmark>.json. The results are then
+# compared to CUTIE_BENCHMARK_BASELINE_DIR/<benchmark>.json, and `all_benchmarks` fails if a benchmark got
+# slower by more than CUTIE_BENCHMARK_THRESHOLD percent.
+# Function has no parameters
+function(add_cutie_all_benchmarks_target)
+    set(RESULTS_DIR ${PROJECT_BINARY_DIR}/benchmarks)
+    get_filename_component(BENCHMARKS_SCRIPT ${CUTIE_DIR}/inc/Benchmarks.cmake ABSOLUTE)
+    set(COMMANDS)
+    foreach (BENCHMARK_NAME ${BENCHMARK_TARGETS})
+        list(APPEND COMMANDS COMMAND $<TARGET_FILE:${BENCHMARK_NAME}>
+                --benchmark_out=${RESULTS_DIR}/${BENCHMARK_NAME}.json
+                --benchmark_out_format=json)
+    endforeach ()
+    # Benchmarks run one at a time, so they don't compete for the cores
+    add_custom_target(all_benchmarks
+            COMMAND ${CMAKE_COMMAND} -E make_directory ${RESULTS_DIR}
+            ${COMMANDS}
+            COMMAND ${CMAKE_COMMAND}
+            -DMODE=compare
+            -DRESULTS_DIR=${RESULTS_DIR}
+            -DBASELINE_DIR=${CUTIE_BENCHMARK_BASELINE_DIR}
+            -DTHRESHOLD=${CUTIE_BENCHMARK_THRESHOLD}
+            -P ${BENCHMARKS_SCRIPT}
+            WORKING_DIRECTORY ${PROJECT_BINARY_DIR}
+            VERBATIM)
+    add_dependencies(all_benchmarks ${BENCHMARK_TARGETS})
+
+    add_custom_target(update_benchmark_baseline
+            COMMAND ${CMAKE_COMMAND}
+            -DMODE=update
+            -DRESULTS_DIR=${RESULTS_DIR}
+            -DBASELINE_DIR=${CUTIE_BENCHMARK_BASELINE_DIR}
+            -P ${BENCHMARKS_SCRIPT}
+            VERBATIM)
 endfunction()
 
-# Defines the `all_tests` target that runs all tests added with add_cutie_test_target()
+# Defines the `all_tests` target that runs all tests added with add_cutie_test_target(),
+# and the `update_test_times_baseline` target that stores their latest times as the baseline
+# Tests run in parallel, CUTIE_TEST_JOBS at a time. CTest keeps each test's duration in
+# Testing/Temporary/CTestCostData.txt under the build directory, and starts the longest tests first on the next run.
+# Each test case appends its times to ${PROJECT_BINARY_DIR}/test_times.jsonl (see inc/test_resources.hpp), which
+# are then compared to CUTIE_TEST_TIMES_BASELINE. Tests using only hook.hpp, without mock.hpp, must include
+# inc/test_resources.hpp to be timed.
 # Function has no parameters
 function(add_cutie_all_tests_target)
+    set(RESULTS ${PROJECT_BINARY_DIR}/test_times.jsonl)
+    get_filename_component(TEST_TIMES_SCRIPT ${CUTIE_DIR}/inc/TestTimes.cmake ABSOLUTE)
     add_custom_target(all_tests
-            COMMAND ctest
+            COMMAND ${CMAKE_COMMAND} -E remove -f ${RESULTS}
+            COMMAND ${CMAKE_COMMAND} -E env CUTIE_TEST_RESULTS=${RESULTS} ctest --parallel ${CUTIE_TEST_JOBS}
+            COMMAND ${CMAKE_COMMAND}
+            -DMODE=compare
+            -DRESULTS=${RESULTS}
+            -DBASELINE=${CUTIE_TEST_TIMES_BASELINE}
+            -DTHRESHOLD=${CUTIE_TEST_TIME_THRESHOLD}
+            -DMIN_TIME=${CUTIE_TEST_TIME_MIN}
+            -DACTION=${CUTIE_TEST_TIME_REGRESSION}
+            -P ${TEST_TIMES_SCRIPT}
             WORKING_DIRECTORY ${PROJECT_BINARY_DIR}
             VERBATIM)
     add_dependencies(all_tests ${TEST_TARGETS})
+
+    add_custom_target(update_test_times_baseline
+            COMMAND ${CMAKE_COMMAND}
+            -DMODE=update
+            -DRESULTS=${RESULTS}
+            -DBASELINE=${CUTIE_TEST_TIMES_BASELINE}
+            -P ${TEST_TIMES_SCRIPT}
+            VERBATIM)
+endfunction()
+
+# Defines the `changed_tests` target that runs only the tests affected by the changes in the git working tree
+# The changes are taken from `git diff` against CUTIE_CHANGED_TESTS_BASE (HEAD by default), which can be overridden
+# by the environment variable of the same name. For example:
+#     CUTIE_CHANGED_TESTS_BASE=origin/master make changed_tests
+# Should be called after all add_cutie_test_target() and add_cutie_coverage_targets() calls.
+# Function has no parameters
+function(add_cutie_changed_tests_target)
+    # The sources of each test, as absolute paths
+    set(SOURCES_MAP ${PROJECT_BINARY_DIR}/cutie_test_sources.txt)
+    set(LINES "")
+    foreach (TARGET_NAME ${TEST_TARGETS})
+        get_target_property(TARGET_SOURCE_DIR ${TARGET_NAME} SOURCE_DIR)
+        get_target_property(TARGET_BINARY_DIR ${TARGET_NAME} BINARY_DIR)
+        get_target_property(TARGET_SOURCES ${TARGET_NAME} SOURCES)
+        foreach (SOURCE ${TARGET_SOURCES})
+            get_filename_component(SOURCE ${SOURCE} ABSOLUTE BASE_DIR ${TARGET_SOURCE_DIR})
+            string(APPEND LINES "${TARGET_NAME}\t${SOURCE}\n")
+        endforeach ()
+        # The compiler's dependency files, listing the headers, are read after the build
+        string(APPEND LINES "${TARGET_NAME}\t@${TARGET_BINARY_DIR}/CMakeFiles/${TARGET_NAME}.dir\n")
+    endforeach ()
+    file(WRITE ${SOURCES_MAP} "${LINES}")
+
+    set(CUTIE_CHANGED_TESTS_BASE HEAD CACHE STRING "The git revision the changed_tests target compares the working tree to")
+    get_filename_component(CHANGED_TESTS_SCRIPT ${CUTIE_DIR}/inc/ChangedTests.cmake ABSOLUTE)
+    # The tests are built first. Make rebuilds only those affected by the changes.
+    add_custom_target(changed_tests
+            COMMAND ${CMAKE_COMMAND}
+            -DSOURCE_DIR=${PROJECT_SOURCE_DIR}
+            -DBASE=${CUTIE_CHANGED_TESTS_BASE}
+            -DMAPS=${SOURCES_MAP}|${PROJECT_BINARY_DIR}/cutie_coverage_sources.txt
+            -DJOBS=${CUTIE_TEST_JOBS}
+            -P ${CHANGED_TESTS_SCRIPT}
+            WORKING_DIRECTORY ${PROJECT_BINARY_DIR}
+            VERBATIM)
+    add_dependencies(changed_tests ${TEST_TARGETS})
 endfunction()
 
 # Defines the following two targets:
 #   1. `coverage` runs all tests and collects coverage
 #   2. `clean_coverage` cleans coverage information
 # The collected coverage report resides in the coverage/ directory under the project's directory.
+# Unless CUTIE_COVERAGE is ON, the `coverage` target builds and runs the instrumented <test>_coverage copies,
+# so it must be called after all add_cutie_test_target() calls.
 # Function has no parameters
 function(add_cutie_coverage_targets)
     include(${CUTIE_DIR}/inc/CodeCoverage.cmake)
     set(COVERAGE_DIR coverage)
-    setup_target_for_coverage_lcov(
-            NAME ${COVERAGE_DIR}
-            EXECUTABLE ctest
-            EXCLUDE "${CUTIE_DIR}/*" "/usr/include/*")
+    set(COVERAGE_EXCLUDES "${CUTIE_DIR}/*" "/usr/include/*")
+    if (DEFINED CUTIE_INCLUDE_DIR)
+        list(APPEND COVERAGE_EXCLUDES "${CUTIE_INCLUDE_DIR}/*")
+    endif ()
+    if (NOT CUTIE_COVERAGE_BACKEND STREQUAL "lcov" AND NOT CUTIE_COVERAGE_BACKEND STREQUAL "gcovr")
+        message(FATAL_ERROR "CUTIE_COVERAGE_BACKEND must be lcov or gcovr")
+    endif ()
+
+    if (CUTIE_COVERAGE)
+        # The tests themselves are instrumented, and share their coverage data, so they run one at a time
+        if (CUTIE_COVERAGE_BACKEND STREQUAL "gcovr")
+            setup_target_for_coverage_gcovr_html(
+                    NAME ${COVERAGE_DIR}
+                    EXECUTABLE ctest
+                    EXCLUDE ${COVERAGE_EXCLUDES})
+        else ()
+            setup_target_for_coverage_lcov(
+                    NAME ${COVERAGE_DIR}
+                    EXECUTABLE ctest
+                    EXCLUDE ${COVERAGE_EXCLUDES})
+        endif ()
+    else ()
+        add_cutie_parallel_coverage_target(${COVERAGE_DIR} "${COVERAGE_EXCLUDES}")
+    endif ()
+
     add_custom_target(clean_coverage
-            rm --recursive --force ${COVERAGE_DIR}
+            rm --recursive --force ${COVERAGE_DIR} coverage_data
             COMMAND find -iname "*.gcda" -delete
             COMMAND find -iname "*.gcno" -delete
             WORKING_DIRECTORY ${PROJECT_BINARY_DIR}
             VERBATIM
             COMMENT "Deleting coverage information. Rebuild after this.")
 endfunction()
+
+# Defines the `coverage` target for the instrumented <test>_coverage copies:
+#   1. All copies run in parallel, each writing its coverage data to coverage_data/<test>
+#   2. The data of each test is captured by a command of its own, so the captures run in parallel too
+#   3. The captures are merged into a single report
+# Used by add_cutie_coverage_targets
+function(add_cutie_parallel_coverage_target name excludes)
+    if (CUTIE_COVERAGE_BACKEND STREQUAL "gcovr")
+        set(COVERAGE_TOOL ${GCOVR_PATH})
+        set(CAPTURE_EXTENSION json)
+    else ()
+        set(COVERAGE_TOOL ${LCOV_PATH})
+        set(CAPTURE_EXTENSION info)
+        if (NOT GENHTML_PATH)
+            message(FATAL_ERROR "genhtml not found! Aborting...")
+        endif ()
+    endif ()
+    if (NOT COVERAGE_TOOL)
+        message(FATAL_ERROR "${CUTIE_COVERAGE_BACKEND} not found! Aborting...")
+    endif ()
+
+    set(GCOV_TOOL ${GCOV_PATH})
+    if (CUTIE_COVERAGE_LLVM_COV)
+        find_program(LLVM_COV_PATH llvm-cov)
+        if (NOT LLVM_COV_PATH)
+            message(FATAL_ERROR "llvm-cov not found! Aborting...")
+        endif ()
+        # lcov runs the gcov tool as a single program, without arguments
+        file(WRITE ${PROJECT_BINARY_DIR}/CMakeFiles/llvm-gcov "#!/bin/sh\nexec ${LLVM_COV_PATH} gcov \"$@\"\n")
+        file(COPY ${PROJECT_BINARY_DIR}/CMakeFiles/llvm-gcov DESTINATION ${PROJECT_BINARY_DIR}
+                FILE_PERMISSIONS OWNER_READ OWNER_WRITE OWNER_EXECUTE GROUP_READ GROUP_EXECUTE WORLD_READ WORLD_EXECUTE)
+        set(GCOV_TOOL ${PROJECT_BINARY_DIR}/llvm-gcov)
+    endif ()
+
+    set(ABSOLUTE_EXCLUDES)
+    foreach (EXCLUDE ${excludes})
+        get_filename_component(EXCLUDE ${EXCLUDE} ABSOLUTE BASE_DIR ${PROJECT_SOURCE_DIR})
+        list(APPEND ABSOLUTE_EXCLUDES ${EXCLUDE})
+    endforeach ()
+    string(REPLACE ";" "|" ABSOLUTE_EXCLUDES "${ABSOLUTE_EXCLUDES}")
+    get_filename_component(CAPTURE_SCRIPT ${CUTIE_DIR}/inc/CoverageCapture.cmake ABSOLUTE)
+    set(DATA_DIR ${PROJECT_BINARY_DIR}/coverage_data)
+    set(SCRIPT_ARGUMENTS
+            -DBACKEND=${CUTIE_COVERAGE_BACKEND}
+            -DTOOL=${COVERAGE_TOOL}
+            -DGCOV=${GCOV_TOOL}
+            -DBASE_DIR=${PROJECT_SOURCE_DIR})
+
+    # Symbolic, so the tests rerun every time the target is built
+    set(RUN_STAMP ${DATA_DIR}/run.stamp)
+    add_custom_command(OUTPUT ${RUN_STAMP}
+            COMMAND ${CMAKE_COMMAND} -E remove_directory ${DATA_DIR}
+            COMMAND ctest -C Coverage -L cutie_coverage --parallel ${CUTIE_TEST_JOBS}
+            DEPENDS ${COVERAGE_TEST_TARGETS}
+            WORKING_DIRECTORY ${PROJECT_BINARY_DIR}
+            VERBATIM
+            COMMENT "Running tests for coverage")
+    set_source_files_properties(${RUN_STAMP} PROPERTIES SYMBOLIC ON)
+
+    set(CAPTURES)
+    foreach (TARGET_NAME ${COVERAGE_TEST_TARGETS})
+        get_target_property(TARGET_BINARY_DIR ${TARGET_NAME} BINARY_DIR)
+        get_target_property(TESTS ${TARGET_NAME} CUTIE_COVERAGE_TESTS)
+        get_target_property(TESTED_TARGET ${TARGET_NAME} CUTIE_TESTED_TARGET)
+        foreach (TEST_NAME ${TESTS})
+            set(CAPTURE ${DATA_DIR}/${TEST_NAME}.${CAPTURE_EXTENSION})
+            add_custom_command(OUTPUT ${CAPTURE}
+                    COMMAND ${CMAKE_COMMAND} -DMODE=capture ${SCRIPT_ARGUMENTS}
+                    -DDATA_DIR=${DATA_DIR}/${TEST_NAME}
+                    -DOBJECT_DIR=${TARGET_BINARY_DIR}/CMakeFiles/${TARGET_NAME}.dir
+                    -DBUILD_DIR=${PROJECT_BINARY_DIR}
+                    -DOUTPUT=${CAPTURE}
+                    -DTARGET=${TESTED_TARGET}
+                    -P ${CAPTURE_SCRIPT}
+                    DEPENDS ${RUN_STAMP}
+                    WORKING_DIRECTORY ${PROJECT_BINARY_DIR}
+                    VERBATIM
+                    COMMENT "Capturing coverage of ${TEST_NAME}")
+            list(APPEND CAPTURES ${CAPTURE})
+        endforeach ()
+    endforeach ()
+
+    set(DEMANGLE OFF)
+    if (CPPFILT_PATH)
+        set(DEMANGLE ON)
+    endif ()
+    add_custom_target(${name}
+            COMMAND ${CMAKE_COMMAND} -DMODE=merge ${SCRIPT_ARGUMENTS}
+            -DDATA_DIR=${DATA_DIR}
+            -DOUTPUT=${PROJECT_BINARY_DIR}/${name}.info
+            -DREPORT_DIR=${PROJECT_BINARY_DIR}/${name}
+            -DEXCLUDES=${ABSOLUTE_EXCLUDES}
+            -DGENHTML=${GENHTML_PATH}
+            -DDEMANGLE=${DEMANGLE}
+            -DSOURCES_MAP=${PROJECT_BINARY_DIR}/cutie_coverage_sources.txt
+            -P ${CAPTURE_SCRIPT}
+            DEPENDS ${CAPTURES}
+            BYPRODUCTS ${PROJECT_BINARY_DIR}/${name}.info ${PROJECT_BINARY_DIR}/${name}.info.total
+            WORKING_DIRECTORY ${PROJECT_BINARY_DIR}
+            VERBATIM
+            COMMENT "Merging coverage captures. Open ./${name}/index.html in your browser to view the coverage report.")
+endfunction()
@@ -0,0 +1,10 @@
+// The functions hooked and mocked by overhead_benchmark.cpp
+// Kept in a file of their own, so the compiler can't inline them into the benchmarks
+
+int benchmarked_function(int a, int b) {
+    return a + b;
+}
+
+int another_benchmarked_function(int a, int b) {
+    return a - b;
+}
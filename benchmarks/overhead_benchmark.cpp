@@ -0,0 +1,160 @@
+// Benchmarks of Cutie's own hooks and mocks
+// Measures the time and the heap allocations of each facility, per operation, so regressions in Cutie itself
+// show up, and so the costs of hooks and mocks can be compared.
+// Build it like any other benchmark, on x86 or x86-64:
+//     add_cutie_benchmark_target(BENCHMARK ${CUTIE_DIR}/benchmarks/overhead_benchmark.cpp
+//             SOURCES ${CUTIE_DIR}/benchmarks/benchmark_code.c)
+
+extern "C" {
+#include <stdlib.h>
+}
+
+#include <new>
+#include <benchmark/benchmark.h>
+
+#include "mock.hpp"
+#include "hook.hpp"
+
+using namespace testing;
+
+extern "C" {
+int benchmarked_function(int a, int b);
+int another_benchmarked_function(int a, int b);
+}
+
+//@formatter:off
+DECLARE_HOOKABLE(benchmarked_function);
+DECLARE_MOCKABLE(another_benchmarked_function, 2);
+//@formatter:on
+
+// Every heap allocation made through new, counted by the replacements below
+static size_t g_allocations = 0;
+
+void* operator new(size_t size) {
+    ++g_allocations;
+    void* memory = malloc(size ? size : 1);
+    if (nullptr == memory) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    free(memory);
+}
+
+// Reports the allocations made since construction as the benchmark's allocs/op counter
+class CAllocationCounter {
+private:
+    benchmark::State& m_state;
+    size_t m_start;
+
+public:
+    explicit CAllocationCounter(benchmark::State& state) : m_state(state), m_start(g_allocations) {}
+
+    ~CAllocationCounter() {
+        m_state.counters["allocs/op"] = benchmark::Counter((double) (g_allocations - m_start),
+                                                           benchmark::Counter::kAvgIterations);
+    }
+};
+
+static int __STUB__benchmarked_function(int a, int b) {
+    return a * b;
+}
+
+static int __STUB__forwarding_benchmarked_function(int a, int b) {
+    SCOPE_REMOVE_HOOK(benchmarked_function);
+    return benchmarked_function(a, b);
+}
+
+static int __STUB__trampoline_benchmarked_function(int a, int b) {
+    return CALL_ORIGINAL(benchmarked_function, a, b);
+}
+
+// The cost of calling the function without hooks, to compare the other benchmarks to
+static void BM_DirectCall(benchmark::State& state) {
+    int a = 1;
+    CAllocationCounter counter(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(benchmarked_function(a, 2));
+    }
+}
+BENCHMARK(BM_DirectCall);
+
+// The cost of calling a hooked function, through the jump to the stub
+static void BM_HookedCall(benchmark::State& state) {
+    INSTALL_HOOK(benchmarked_function, __STUB__benchmarked_function);
+    int a = 1;
+    CAllocationCounter counter(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(benchmarked_function(a, 2));
+    }
+}
+BENCHMARK(BM_HookedCall);
+
+// The cost of installing a hook and removing it when scope ends
+static void BM_ScopedHookInstall(benchmark::State& state) {
+    CAllocationCounter counter(state);
+    for (auto _ : state) {
+        INSTALL_HOOK(benchmarked_function, __STUB__benchmarked_function);
+    }
+}
+BENCHMARK(BM_ScopedHookInstall);
+
+// The cost of replacing the stub of an installed hook
+static void BM_ReplaceHook(benchmark::State& state) {
+    INSTALL_HOOK(benchmarked_function, __STUB__benchmarked_function);
+    void* stubs[] = {(void*) __STUB__benchmarked_function, (void*) __STUB__trampoline_benchmarked_function};
+    size_t index = 0;
+    CAllocationCounter counter(state);
+    for (auto _ : state) {
+        index ^= 1;
+        REPLACE_HOOK(benchmarked_function, stubs[index]);
+    }
+}
+BENCHMARK(BM_ReplaceHook);
+
+// The cost of a call whose stub forwards to the original function by removing the hook for the call
+static void BM_ScopedHookRemoveForwarding(benchmark::State& state) {
+    INSTALL_HOOK(benchmarked_function, __STUB__forwarding_benchmarked_function);
+    int a = 1;
+    CAllocationCounter counter(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(benchmarked_function(a, 2));
+    }
+}
+BENCHMARK(BM_ScopedHookRemoveForwarding);
+
+// The cost of a call whose stub forwards to the original function through its trampoline
+static void BM_CallOriginalForwarding(benchmark::State& state) {
+    INSTALL_HOOK(benchmarked_function, __STUB__trampoline_benchmarked_function);
+    int a = 1;
+    CAllocationCounter counter(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(benchmarked_function(a, 2));
+    }
+}
+BENCHMARK(BM_CallOriginalForwarding);
+
+// The cost of calling a mocked function, with the given number of expectations set.
+// The call matches the oldest expectation, so GMock goes through all of them.
+static void BM_MockedCall(benchmark::State& state) {
+    INSTALL_MOCK(another_benchmarked_function);
+    int expectations = (int) state.range(0);
+    if (expectations > 0) {
+        CUTIE_EXPECT_CALL(another_benchmarked_function, 1, _).WillRepeatedly(Return(3));
+    }
+    for (int i = 1; i < expectations; ++i) {
+        CUTIE_EXPECT_CALL(another_benchmarked_function, 1000 + i, _).WillRepeatedly(Return(i));
+    }
+    int a = 1;
+    CAllocationCounter counter(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(another_benchmarked_function(a, 2));
+    }
+}
+BENCHMARK(BM_MockedCall)->Arg(0)->Arg(1)->Arg(50);
@@ -10,6 +10,8 @@
 	-------
 	SubHook is a super-simple hooking library for C/C++ that works on Linux and
 	Windows. It currently supports x86 and x86-64.
+	On AArch64, Cutie builds the trampolines itself (see inc/subhook_arm64.hpp),
+	and the hooks below work the same.
 
 	When should I use hooks?
 	------------------------
@@ -59,20 +61,174 @@
 		  If you don't call the original function from within the stub, the line can be omitted.
 		* INSTALL_HOOK() installs a hook on fopen() that will invoke the stub.
 
+	Calling the original function
+	-----------------------------
+	SCOPE_REMOVE_HOOK removes the hook and reinstalls it when the scope ends, which
+	patches the function twice on every call to the stub, and isn't safe if the function
+	is called recursively or from other threads meanwhile.
+	CALL_ORIGINAL calls the original function through its trampoline instead, which
+	costs a single indirect call:
+
+		FILE* __STUB__fopen_log(const char* path, const char* mode) {
+			std::cout << "Opening " << path << std::endl;
+			return CALL_ORIGINAL(fopen, path, mode);
+		}
+
+	SCOPE_REMOVE_HOOK is still needed for the rare functions Subhook can't build a
+	trampoline for (see HAS_ORIGINAL).
+
+	Installing many hooks at once
+	-----------------------------
+	Every INSTALL_HOOK changes the protection of the function's page, patches it,
+	and restores. When a test stubs dozens of functions, a hook set installs them
+	all in a single batch, changing the protection of each page only once:
+
+		DECLARE_HOOKABLE(fopen);
+		DECLARE_HOOKABLE(fclose);
+
+		TEST(MYMODULE, no_files) {
+			DECLARE_HOOK_SET(hooks);
+			HOOK_SET_ADD(hooks, fopen, __STUB__fopen_fail);
+			HOOK_SET_ADD(hooks, fclose, __STUB__fclose_fail);
+			HOOK_SET_INSTALL(hooks);
+			EXPECT_EQ(MYMODULE_calculate(), -1);
+		}
+
+	All the hooks in the set are removed together when the set goes out of scope.
+	Mocks can be added to a set too, see HOOK_SET_ADD_MOCK in mock.hpp.
+
+	Spies
+	-----
+	Sometimes we only want to know how many times a function was called, and with
+	which arguments, without changing its behavior. Mocks can do that, but they go
+	through GMock's expectation matching on every call, which is slow on hot paths.
+	A spy is a hook with a generated stub that bumps an atomic counter, optionally
+	records the arguments in a preallocated ring buffer, and calls the original
+	function through its trampoline:
+
+		DECLARE_COUNTABLE(fclose);
+		DECLARE_COUNTABLE_WITH_CAPTURE(fwrite, 16);
+
+		TEST(MYMODULE, writes_once) {
+			INSTALL_SPY(fclose);
+			INSTALL_SPY(fwrite);
+			MYMODULE_calculate();
+			EXPECT_EQ(SPY_CALL_COUNT(fclose), 1);
+			EXPECT_EQ(std::get<1>(SPY_CALL_ARGS(fwrite, 0)), 4);
+		}
+
+	Only the arguments of the last `capacity` calls are kept. Only one spy per
+	function may be installed at a time. Functions with ellipsis can't be spied.
+
+	Slow dependencies
+	-----------------
+	To test how a module handles a slow dependency (timeouts, backpressure, tail
+	latency), a latency hook delays every call to a function, then calls the
+	original function through its trampoline:
+
+		using namespace std::chrono_literals;
+
+		DECLARE_LATENCY_HOOKABLE(recv);
+
+		TEST(MYMODULE, slow_network) {
+			INSTALL_LATENCY_HOOK(recv, cutie::CLatency::Percentiles({{50, 1ms}, {99, 20ms}, {100, 200ms}}));
+			EXPECT_EQ(MYMODULE_calculate(), -ETIMEDOUT);
+			EXPECT_GT(LATENCY_HOOK_CALL_COUNT(recv), 0);
+		}
+
+	Delays are Fixed(delay), Uniform(min, max), or follow Percentiles, which must ascend
+	from 0 to 100 (or std::invalid_argument is thrown). They're drawn from a
+	pseudo-random generator with a fixed seed, so every run of the test sees the
+	same delays (call .seed(value) for another sequence). The calling thread
+	sleeps, or busy loops if .spin() is called, for delays shorter than the
+	scheduler's resolution. Only one latency hook per function may be installed at
+	a time. Functions with ellipsis can't be delayed.
+
+	Hooks and threads
+	-----------------
+	By default, hooks are installed by simply overwriting the function's prologue.
+	If other threads may run the function while the hook is installed, replaced or
+	removed, they may crash in the middle of the patch. To avoid that, change the
+	patch mode (see inc/code_patcher.hpp for the details):
+
+		CUTIE_SET_PATCH_MODE(StopTheWorld);  // Suspend all other threads while patching
+		CUTIE_SET_PATCH_MODE(Atomic);        // Patch with a single atomic write when possible
+
+	If the other threads can't be stopped, the function isn't patched, and INSTALL_HOOK
+	(like every other way of installing hooks) throws std::runtime_error, which fails the test.
+	Installing hooks from several threads is always safe, as patching is serialized.
+	Functions wrapped by the linker (see WRAP in Cutie.cmake) are never patched: their
+	hooks are installed with a single pointer store, which is safe in any mode.
+
+	Per-thread hooks
+	----------------
+	INSTALL_HOOK affects all threads, and SCOPE_REMOVE_HOOK removes the hook from all
+	threads while the original function runs. When tests run concurrently in several
+	threads of the same process, use per-thread hooks instead:
+
+		DECLARE_THREAD_HOOKABLE(fopen);
+
+		FILE* __STUB__fopen_log(const char* path, const char* mode) {
+			std::cout << "Opening " << path << std::endl;
+			return CALL_THREAD_ORIGINAL(fopen, path, mode);
+		}
+
+		TEST(MYMODULE, fopen_logged) {
+			INSTALL_THREAD_HOOK(fopen, __STUB__fopen_log);
+			EXPECT_EQ(MYMODULE_calculate(), 0);
+		}
+
+	While any thread has a per-thread hook installed, the function jumps to a dispatcher
+	that calls the stub installed by the calling thread, or the original function if the
+	calling thread has none. CALL_THREAD_ORIGINAL calls the original function through its
+	trampoline, without removing anything.
+	Don't mix INSTALL_HOOK and INSTALL_THREAD_HOOK on the same function.
+
+	Hooking without patching code
+	-----------------------------
+	INSTALL_HOOK makes the function's code writable while it's patched, which hosts
+	that enforce W^X don't allow. Calls to a shared library's function (such as libc's
+	fopen()) go through the dynamic linker, via a pointer in the caller's GOT, so a GOT
+	hook redirects them by storing the stub's address in these pointers instead:
+
+		DECLARE_GOT_HOOKABLE(fopen);
+
+		FILE* __STUB__fopen_log(const char* path, const char* mode) {
+			std::cout << "Opening " << path << std::endl;
+			return CALL_GOT_ORIGINAL(fopen, path, mode);
+		}
+
+		TEST(MYMODULE, fopen_logged) {
+			INSTALL_GOT_HOOK(fopen, __STUB__fopen_log);
+			EXPECT_EQ(MYMODULE_calculate(), 0);
+		}
+
+	Installing and removing a GOT hook is a pointer store per caller, much cheaper than
+	patching code. But only calls from other objects are redirected: a function of the
+	module under test, called from the module itself, must be hooked with INSTALL_HOOK.
+	REPLACE_HOOK works on GOT hooks too. See inc/got_hook.hpp for the details.
+
 ********************************************************************/
 #ifndef CUTIE_HOOK_HPP
 #define CUTIE_HOOK_HPP
 
+#include "inc/call_statistics.hpp"
 #include "inc/c_scoped_hook.hpp"
+#include "inc/got_hook.hpp"
+#include "inc/latency.hpp"
+#include "inc/spy.hpp"
+#include "inc/thread_dispatch.hpp"
 
 /********************************************************************
 	@brief Declare a function as hookable. Must be called once for
 		every function that will be hooked, or else INSTALL_HOOK
 		won't work.
+		May be declared in several test files linked into the same
+		executable (see add_cutie_test_bundle).
 
 	@param func [IN] The function name to mark as hookable
 ********************************************************************/
-#define DECLARE_HOOKABLE(func) subhook_t __hook__##func
+#define DECLARE_HOOKABLE(func) inline subhook_t __hook__##func = nullptr
 
 /********************************************************************
 	@brief Install a hook on a function. The hook takes place
@@ -81,8 +237,14 @@
 	@param func [IN] The function to place a hook on
 	@param stub [IN] The function that will be called
 ********************************************************************/
+#ifdef CUTIE_CALL_STATISTICS
+#define INSTALL_HOOK(func, stub) \
+    cutie::CScopedCountedHook<&(__hook__##func), cutie::Signature<decltype(func)> > __install__##func( \
+            #func, (void*)(func), (void*)(stub))
+#else
 #define INSTALL_HOOK(func, stub) \
     cutie::CScopedHookInstall __install__##func(&(__hook__##func), (void*)(func), (void*)(stub))
+#endif
 
 /********************************************************************
 	@brief Replace a currently installed hook.
@@ -102,4 +264,215 @@
 ********************************************************************/
 #define SCOPE_REMOVE_HOOK(func) cutie::CScopedHookRemove __remove__##__LINE__(&(__hook__##func))
 
+/********************************************************************
+	@brief Declare a set of hooks to be installed together.
+		All the hooks in the set are removed when scope ends.
+
+	@param set [IN] The name of the set
+********************************************************************/
+#define DECLARE_HOOK_SET(set) cutie::CScopedHookSet set
+
+/********************************************************************
+	@brief Add a hook to a set. The hook takes place on HOOK_SET_INSTALL.
+
+	@param set [IN] The set declared with DECLARE_HOOK_SET
+	@param func [IN] The function to place a hook on
+	@param stub [IN] The function that will be called
+********************************************************************/
+#define HOOK_SET_ADD(set, func, stub) ((set).Add(&(__hook__##func), (void*)(func), (void*)(stub)))
+
+/********************************************************************
+	@brief Install all the hooks added to a set, in a single batch.
+
+	@param set [IN] The set declared with DECLARE_HOOK_SET
+********************************************************************/
+#define HOOK_SET_INSTALL(set) ((set).Install())
+
+/********************************************************************
+	@brief Call the original function of a hooked function, through
+		its trampoline. The hook stays installed.
+		Can be called from within the stub, or from anywhere else
+		while the hook is installed.
+
+	@param func [IN] The function that was hooked
+	@param ... [IN] The arguments to pass to the original function
+********************************************************************/
+#ifdef CUTIE_CALL_STATISTICS
+#define CALL_ORIGINAL(func, ...) \
+    (cutie::COriginalCallTimer(cutie::CScopedCountedHook<&(__hook__##func), \
+            cutie::Signature<decltype(func)> >::Statistics(#func)), \
+     ((decltype(func)*) cutie::Trampoline(__hook__##func))(__VA_ARGS__))
+#else
+#define CALL_ORIGINAL(func, ...) \
+    (((decltype(func)*) cutie::Trampoline(__hook__##func))(__VA_ARGS__))
+#endif
+
+/********************************************************************
+	@brief Whether CALL_ORIGINAL can be used on a hooked function.
+		Subhook can't build a trampoline for a few functions, whose
+		prologue can't be relocated. For those, use SCOPE_REMOVE_HOOK.
+
+	@param func [IN] The function that was hooked
+********************************************************************/
+#define HAS_ORIGINAL(func) (nullptr != cutie::Trampoline(__hook__##func))
+
+/********************************************************************
+	@brief Declare a function as hookable per-thread. Must be called
+		once for every function that will be hooked with
+		INSTALL_THREAD_HOOK.
+
+	@param func [IN] The function name to mark as hookable
+********************************************************************/
+#define DECLARE_THREAD_HOOKABLE(func) \
+    struct __thread_hook_tag__##func; \
+    typedef cutie::CThreadDispatcher<__thread_hook_tag__##func, cutie::Signature<decltype(func)> > ThreadDispatcher_##func
+
+/********************************************************************
+	@brief Install a hook on a function for the current thread only.
+		The hook takes place immediately. The hook is removed when
+		scope ends. Other threads keep calling the original function,
+		or their own stubs.
+
+	@param func [IN] The function to place a hook on
+	@param stub [IN] The function that will be called
+********************************************************************/
+#define INSTALL_THREAD_HOOK(func, stub) \
+    ThreadDispatcher_##func::CScopedInstall __thread_install__##func((void*)(func), (void*)(stub))
+
+/********************************************************************
+	@brief Replace a currently installed per-thread hook.
+
+	@param func [IN] The function to place a hook on
+	@param stub [IN] The function that will be called
+********************************************************************/
+#define REPLACE_THREAD_HOOK(func, stub) (__thread_install__##func.Replace((void*)(stub)))
+
+/********************************************************************
+	@brief Call the original function of a per-thread hook, from
+		within the stub or from anywhere else.
+
+	@param func [IN] The function that was hooked
+	@param ... [IN] The arguments to pass to the original function
+********************************************************************/
+#define CALL_THREAD_ORIGINAL(func, ...) (ThreadDispatcher_##func::original()(__VA_ARGS__))
+
+/********************************************************************
+	@brief Declare a function as hookable through the GOT. Must be
+		called once for every function that will be hooked with
+		INSTALL_GOT_HOOK.
+
+	@param func [IN] The function name to mark as hookable
+********************************************************************/
+#define DECLARE_GOT_HOOKABLE(func) inline void* __got_original__##func = nullptr
+
+/********************************************************************
+	@brief Install a hook on the calls to a function made through the
+		dynamic linker, by all loaded objects. The hook takes place
+		immediately. The hook is removed when scope ends.
+
+	@param func [IN] The function to place a hook on
+	@param stub [IN] The function that will be called
+********************************************************************/
+#define INSTALL_GOT_HOOK(func, stub) \
+    cutie::CScopedGotHook __install__##func(&(__got_original__##func), #func, (void*)(stub))
+
+/********************************************************************
+	@brief Call the original function of a GOT hook, from within the
+		stub or from anywhere else.
+
+	@param func [IN] The function that was hooked
+	@param ... [IN] The arguments to pass to the original function
+********************************************************************/
+#define CALL_GOT_ORIGINAL(func, ...) (((decltype(func)*) __got_original__##func)(__VA_ARGS__))
+
+/********************************************************************
+	@brief Set how hooks are written into functions, for all hooks
+		installed, replaced or removed from now on.
+
+	@param mode [IN] One of Plain, Atomic or StopTheWorld
+********************************************************************/
+#define CUTIE_SET_PATCH_MODE(mode) (cutie::CCodePatcher::Instance().set_mode(cutie::PatchMode::mode))
+
+/********************************************************************
+	@brief Declare a function as countable. Must be called once for
+		every function that will be spied on with INSTALL_SPY.
+		Only the number of calls is recorded.
+
+	@param func [IN] The function name to mark as countable
+********************************************************************/
+#define DECLARE_COUNTABLE(func) DECLARE_COUNTABLE_WITH_CAPTURE(func, 0)
+
+/********************************************************************
+	@brief Declare a function as countable, and record the arguments
+		of its most recent calls.
+
+	@param func [IN] The function name to mark as countable
+	@param capacity [IN] The number of most recent calls to record
+********************************************************************/
+#define DECLARE_COUNTABLE_WITH_CAPTURE(func, capacity) \
+    struct __spy_tag__##func; \
+    typedef cutie::CSpy<__spy_tag__##func, cutie::Signature<decltype(func)>, (capacity)> Spy_##func
+
+/********************************************************************
+	@brief Install a spy on a function. The spy takes place
+		immediately, and counts calls from zero. The spy is removed
+		when scope ends.
+
+	@param func [IN] The function to spy on
+********************************************************************/
+#define INSTALL_SPY(func) Spy_##func __spy__##func((void*)(func))
+
+/********************************************************************
+	@brief The number of calls to a spied function since INSTALL_SPY.
+
+	@param func [IN] The spied function
+********************************************************************/
+#define SPY_CALL_COUNT(func) (__spy__##func.calls())
+
+/********************************************************************
+	@brief The arguments of a call to a spied function, as a std::tuple.
+		Only the most recent calls are recorded, and can be checked
+		with __spy__func.is_captured(index).
+
+	@param func [IN] The spied function
+	@param index [IN] The index of the call, starting from 0
+********************************************************************/
+#define SPY_CALL_ARGS(func, index) (__spy__##func.arguments(index))
+
+/********************************************************************
+	@brief Declare a function as delayable. Must be called once for
+		every function that will be delayed with INSTALL_LATENCY_HOOK.
+
+	@param func [IN] The function name to mark as delayable
+********************************************************************/
+#define DECLARE_LATENCY_HOOKABLE(func) \
+    struct __latency_tag__##func; \
+    typedef cutie::CLatencyHook<__latency_tag__##func, cutie::Signature<decltype(func)> > LatencyHook_##func
+
+/********************************************************************
+	@brief Install a latency hook on a function. Every call waits for
+		a delay drawn from the distribution, then calls the original
+		function. The hook is removed when scope ends.
+
+	@param func [IN] The function to delay
+	@param latency [IN] The distribution of delays, a cutie::CLatency
+********************************************************************/
+#define INSTALL_LATENCY_HOOK(func, latency) LatencyHook_##func __latency__##func((void*)(func), (latency))
+
+/********************************************************************
+	@brief The number of calls to a delayed function since
+		INSTALL_LATENCY_HOOK.
+
+	@param func [IN] The delayed function
+********************************************************************/
+#define LATENCY_HOOK_CALL_COUNT(func) (__latency__##func.calls())
+
+/********************************************************************
+	@brief The sum of the delays injected into a function since
+		INSTALL_LATENCY_HOOK, as std::chrono::nanoseconds.
+
+	@param func [IN] The delayed function
+********************************************************************/
+#define LATENCY_HOOK_TOTAL_DELAY(func) (__latency__##func.total_delay())
+
 #endif // CUTIE_HOOK_HPP
@@ -0,0 +1,158 @@
+# Benchmarks
+# ~~~~~~~~~~
+# Run by the `all_benchmarks` and `update_benchmark_baseline` targets in script mode (cmake -P).
+#
+# Comparing (MODE=compare):
+#   Compares the CPU time of each benchmark in RESULTS_DIR/<benchmark>.json to the same benchmark
+#   in BASELINE_DIR/<benchmark>.json, and fails if any of them got slower by more than THRESHOLD percent.
+#   Benchmarks missing from the baseline are reported, but aren't regressions.
+#   When benchmarks run with repetitions, only their mean is compared.
+#
+# Updating (MODE=update):
+#   Copies the results in RESULTS_DIR to BASELINE_DIR.
+#
+#   RESULTS_DIR  - The directory of the latest results, as written by Google Benchmark's --benchmark_out
+#   BASELINE_DIR - The directory of the stored results
+#   THRESHOLD    - The slowdown, in percent, reported as a regression
+#
+cmake_minimum_required(VERSION 3.10)
+
+# CMake's math is integer only, so times are compared in picoseconds.
+# Converts a JSON number in the given time unit to picoseconds.
+function(to_picoseconds value unit output_variable)
+    if (NOT value MATCHES "^([0-9]*)(\\.([0-9]*))?([eE]([+-]?[0-9]+))?$")
+        message(FATAL_ERROR "Unexpected benchmark time '${value}'")
+    endif ()
+    set(DIGITS "${CMAKE_MATCH_1}${CMAKE_MATCH_3}")
+    string(LENGTH "${CMAKE_MATCH_3}" FRACTION_LENGTH)
+    set(EXPONENT 0)
+    if (CMAKE_MATCH_5)
+        set(EXPONENT ${CMAKE_MATCH_5})
+    endif ()
+    if (unit STREQUAL "ns")
+        set(UNIT_EXPONENT 3)
+    elseif (unit STREQUAL "us")
+        set(UNIT_EXPONENT 6)
+    elseif (unit STREQUAL "ms")
+        set(UNIT_EXPONENT 9)
+    else ()
+        set(UNIT_EXPONENT 12)
+    endif ()
+    math(EXPR EXPONENT "${EXPONENT} - ${FRACTION_LENGTH} + ${UNIT_EXPONENT}")
+
+    # Keep the number in 64 bits
+    string(REGEX REPLACE "^0+" "" DIGITS "${DIGITS}")
+    string(LENGTH "${DIGITS}" DIGITS_LENGTH)
+    if (DIGITS_LENGTH GREATER 15)
+        math(EXPR EXPONENT "${EXPONENT} + ${DIGITS_LENGTH} - 15")
+        string(SUBSTRING "${DIGITS}" 0 15 DIGITS)
+    endif ()
+    if (NOT DIGITS)
+        set(DIGITS 0)
+    endif ()
+    while (EXPONENT GREATER 0)
+        string(APPEND DIGITS 0)
+        math(EXPR EXPONENT "${EXPONENT} - 1")
+    endwhile ()
+    if (EXPONENT LESS 0)
+        string(LENGTH "${DIGITS}" DIGITS_LENGTH)
+        math(EXPR DIGITS_LENGTH "${DIGITS_LENGTH} + ${EXPONENT}")
+        if (DIGITS_LENGTH GREATER 0)
+            string(SUBSTRING "${DIGITS}" 0 ${DIGITS_LENGTH} DIGITS)
+        else ()
+            set(DIGITS 0)
+        endif ()
+    endif ()
+    set(${output_variable} ${DIGITS} PARENT_SCOPE)
+endfunction()
+
+# Reads the benchmarks of a results file, setting <prefix>_NAMES to their names,
+# and <prefix>_<name> to the CPU time of each, in picoseconds
+function(read_benchmark_results file prefix)
+    file(READ ${file} CONTENT)
+    string(JSON COUNT LENGTH "${CONTENT}" benchmarks)
+    set(NAMES)
+    if (COUNT GREATER 0)
+        math(EXPR LAST "${COUNT} - 1")
+        foreach (INDEX RANGE ${LAST})
+            string(JSON BENCHMARK GET "${CONTENT}" benchmarks ${INDEX})
+            string(JSON RUN_TYPE ERROR_VARIABLE ERROR GET "${BENCHMARK}" run_type)
+            if (RUN_TYPE STREQUAL "aggregate")
+                string(JSON AGGREGATE GET "${BENCHMARK}" aggregate_name)
+                if (NOT AGGREGATE STREQUAL "mean")
+                    continue()
+                endif ()
+                string(JSON NAME GET "${BENCHMARK}" run_name)
+            else ()
+                string(JSON REPETITIONS ERROR_VARIABLE ERROR GET "${BENCHMARK}" repetitions)
+                if (REPETITIONS GREATER 1)
+                    continue()
+                endif ()
+                string(JSON NAME GET "${BENCHMARK}" name)
+            endif ()
+            string(JSON TIME GET "${BENCHMARK}" cpu_time)
+            string(JSON UNIT GET "${BENCHMARK}" time_unit)
+            to_picoseconds(${TIME} ${UNIT} PICOSECONDS)
+            list(APPEND NAMES ${NAME})
+            set(${prefix}_${NAME} ${PICOSECONDS} PARENT_SCOPE)
+        endforeach ()
+    endif ()
+    set(${prefix}_NAMES ${NAMES} PARENT_SCOPE)
+endfunction()
+
+function(compare_benchmarks)
+    if (CMAKE_VERSION VERSION_LESS 3.19)
+        message(WARNING "Comparing benchmarks requires CMake 3.19 or newer, the results in ${RESULTS_DIR} weren't compared")
+        return()
+    endif ()
+    file(GLOB RESULTS RELATIVE ${RESULTS_DIR} ${RESULTS_DIR}/*.json)
+    set(REGRESSIONS 0)
+    foreach (RESULT ${RESULTS})
+        get_filename_component(BENCHMARK_FILE ${RESULT} NAME_WE)
+        if (NOT EXISTS ${BASELINE_DIR}/${RESULT})
+            message(STATUS "${BENCHMARK_FILE}: no baseline")
+            continue()
+        endif ()
+        read_benchmark_results(${RESULTS_DIR}/${RESULT} CURRENT)
+        read_benchmark_results(${BASELINE_DIR}/${RESULT} BASELINE)
+        foreach (NAME ${CURRENT_NAMES})
+            if (NOT NAME IN_LIST BASELINE_NAMES)
+                message(STATUS "${BENCHMARK_FILE}: ${NAME}: no baseline")
+                continue()
+            endif ()
+            set(CURRENT ${CURRENT_${NAME}})
+            set(BASELINE ${BASELINE_${NAME}})
+            if (BASELINE EQUAL 0)
+                continue()
+            endif ()
+            math(EXPR CHANGE "(${CURRENT} - ${BASELINE}) * 100 / ${BASELINE}")
+            if (CHANGE GREATER THRESHOLD)
+                message(STATUS "${BENCHMARK_FILE}: ${NAME}: ${CHANGE}% slower than the baseline (REGRESSION)")
+                math(EXPR REGRESSIONS "${REGRESSIONS} + 1")
+            else ()
+                message(STATUS "${BENCHMARK_FILE}: ${NAME}: ${CHANGE}% change from the baseline")
+            endif ()
+        endforeach ()
+    endforeach ()
+    if (REGRESSIONS GREATER 0)
+        message(FATAL_ERROR "${REGRESSIONS} benchmarks got slower by more than ${THRESHOLD}%")
+    endif ()
+endfunction()
+
+function(update_benchmark_baseline)
+    file(GLOB RESULTS ${RESULTS_DIR}/*.json)
+    if (NOT RESULTS)
+        message(FATAL_ERROR "No benchmark results in ${RESULTS_DIR}, run the all_benchmarks target first")
+    endif ()
+    file(MAKE_DIRECTORY ${BASELINE_DIR})
+    file(COPY ${RESULTS} DESTINATION ${BASELINE_DIR})
+    message(STATUS "Benchmark baseline updated in ${BASELINE_DIR}")
+endfunction()
+
+if (MODE STREQUAL "compare")
+    compare_benchmarks()
+elseif (MODE STREQUAL "update")
+    update_benchmark_baseline()
+else ()
+    message(FATAL_ERROR "Unknown benchmarks mode '${MODE}'")
+endif ()
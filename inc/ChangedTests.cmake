@@ -0,0 +1,129 @@
+# Changed Tests
+# ~~~~~~~~~~~~~
+# Run by the `changed_tests` target in script mode (cmake -P), to run only the tests affected by the files
+# changed in the git working tree.
+# A test target is affected if a changed file is one of its sources, one of the headers they include (as listed
+# in the compiler's dependency files), or one of the files it covered in the last run of the `coverage` target.
+# Changes to CMake files may change any test, so they run all tests.
+#
+#   SOURCE_DIR - The project's source directory, inside the git working tree
+#   BASE       - The git revision to compare the working tree to. Overridden by the CUTIE_CHANGED_TESTS_BASE
+#                environment variable.
+#   MAPS       - Files of "<target>\t<file>" lines, separated by '|'. A file starting with '@' is an object
+#                directory, whose dependency files are read.
+#   JOBS       - The number of tests to run in parallel
+#
+cmake_minimum_required(VERSION 3.10)
+
+function(run_git output_variable)
+    execute_process(COMMAND git ${ARGN}
+            WORKING_DIRECTORY ${SOURCE_DIR}
+            RESULT_VARIABLE RESULT
+            OUTPUT_VARIABLE OUTPUT
+            OUTPUT_STRIP_TRAILING_WHITESPACE)
+    if (NOT RESULT EQUAL 0)
+        string(REPLACE ";" " " COMMAND_LINE "${ARGN}")
+        message(FATAL_ERROR "git ${COMMAND_LINE} failed")
+    endif ()
+    string(REPLACE "\n" ";" OUTPUT "${OUTPUT}")
+    set(${output_variable} "${OUTPUT}" PARENT_SCOPE)
+endfunction()
+
+# Lists the changed files, as absolute paths, including files git doesn't track yet
+function(get_changed_files output_variable)
+    run_git(TOP_LEVEL rev-parse --show-toplevel)
+    run_git(CHANGED diff --name-only ${BASE} --)
+    run_git(UNTRACKED ls-files --others --exclude-standard --full-name)
+    set(FILES)
+    foreach (FILE ${CHANGED} ${UNTRACKED})
+        get_filename_component(FILE ${TOP_LEVEL}/${FILE} REALPATH)
+        list(APPEND FILES ${FILE})
+    endforeach ()
+    set(${output_variable} ${FILES} PARENT_SCOPE)
+endfunction()
+
+# Lists the files named by the dependency (.d) files under an object directory
+function(get_dependencies object_dir output_variable)
+    file(GLOB_RECURSE DEPENDENCY_FILES ${object_dir}/*.d)
+    set(DEPENDENCIES)
+    foreach (DEPENDENCY_FILE ${DEPENDENCY_FILES})
+        file(READ ${DEPENDENCY_FILE} CONTENT)
+        # Make rules: "object: file file \<newline> file ..."
+        string(REGEX REPLACE "\\\\\n" " " CONTENT "${CONTENT}")
+        string(REGEX REPLACE "[^\n]*: " "" CONTENT "${CONTENT}")
+        string(REGEX REPLACE "[ \t\n]+" ";" CONTENT "${CONTENT}")
+        foreach (FILE ${CONTENT})
+            if (IS_ABSOLUTE ${FILE})
+                list(APPEND DEPENDENCIES ${FILE})
+            endif ()
+        endforeach ()
+    endforeach ()
+    set(${output_variable} ${DEPENDENCIES} PARENT_SCOPE)
+endfunction()
+
+function(run_tests)
+    execute_process(COMMAND ctest --parallel ${JOBS} --output-on-failure ${ARGN}
+            RESULT_VARIABLE RESULT)
+    if (NOT RESULT EQUAL 0)
+        message(FATAL_ERROR "Tests failed")
+    endif ()
+endfunction()
+
+function(run_changed_tests)
+    if (DEFINED ENV{CUTIE_CHANGED_TESTS_BASE})
+        set(BASE $ENV{CUTIE_CHANGED_TESTS_BASE})
+    endif ()
+    get_changed_files(CHANGED_FILES)
+    if (NOT CHANGED_FILES)
+        message(STATUS "No files changed since ${BASE}, no tests affected")
+        return()
+    endif ()
+    foreach (FILE ${CHANGED_FILES})
+        if (FILE MATCHES "(/CMakeLists\\.txt|\\.cmake)$")
+            message(STATUS "${FILE} changed, running all tests")
+            run_tests()
+            return()
+        endif ()
+    endforeach ()
+
+    set(AFFECTED)
+    string(REPLACE "|" ";" MAP_LIST "${MAPS}")
+    foreach (MAP ${MAP_LIST})
+        if (NOT EXISTS ${MAP})
+            continue()
+        endif ()
+        file(STRINGS ${MAP} LINES)
+        foreach (LINE ${LINES})
+            if (NOT LINE MATCHES "^([^\t]+)\t(.+)$")
+                continue()
+            endif ()
+            set(TARGET_NAME ${CMAKE_MATCH_1})
+            set(FILES ${CMAKE_MATCH_2})
+            if (TARGET_NAME IN_LIST AFFECTED)
+                continue()
+            endif ()
+            if (FILES MATCHES "^@(.*)$")
+                get_dependencies(${CMAKE_MATCH_1} FILES)
+            endif ()
+            foreach (FILE ${FILES})
+                get_filename_component(FILE ${FILE} REALPATH)
+                if (FILE IN_LIST CHANGED_FILES)
+                    list(APPEND AFFECTED ${TARGET_NAME})
+                    break()
+                endif ()
+            endforeach ()
+        endforeach ()
+    endforeach ()
+
+    if (NOT AFFECTED)
+        message(STATUS "No tests affected by the changes since ${BASE}")
+        return()
+    endif ()
+    string(REPLACE ";" " " AFFECTED_NAMES "${AFFECTED}")
+    message(STATUS "Running the tests affected by the changes since ${BASE}: ${AFFECTED_NAMES}")
+    # Tests are named after their target, or split into shards or discovered tests of a bundle
+    string(REPLACE ";" "|" AFFECTED_PATTERN "${AFFECTED}")
+    run_tests(--tests-regex "^(${AFFECTED_PATTERN})(_shard[0-9]+|\\..+)?$")
+endfunction()
+
+run_changed_tests()
@@ -0,0 +1,150 @@
+# Coverage Capture
+# ~~~~~~~~~~~~~~~~
+# Run by the `coverage` target in script mode (cmake -P), to capture the coverage of a single test,
+# or to merge the captures of all tests into a report.
+# Each test writes its .gcda files to a directory of its own (using GCOV_PREFIX), so tests can run in parallel,
+# and so can their captures.
+#
+# Capturing (MODE=capture):
+#   DATA_DIR   - The directory the test wrote its .gcda files to
+#   OBJECT_DIR - The object directory of the test's executable, holding its .gcno files
+#   BUILD_DIR  - The directory stripped from the .gcda paths by GCOV_PREFIX_STRIP
+#   OUTPUT     - The capture file to write
+#   TARGET     - The tested target, recorded with the files the test covered (see ChangedTests.cmake)
+#
+# Merging (MODE=merge):
+#   DATA_DIR   - The directory holding the captures of all tests
+#   OUTPUT     - The merged coverage file to write (lcov only)
+#   REPORT_DIR - The directory to write the HTML report to
+#   EXCLUDES   - Patterns of files to leave out of the report, separated by '|'
+#   GENHTML    - The path of genhtml (lcov only)
+#   DEMANGLE   - Whether genhtml demangles C++ names (lcov only)
+#   SOURCES_MAP - The file to write the files covered by each test to
+#
+# Both modes:
+#   BACKEND    - lcov or gcovr
+#   TOOL       - The path of lcov or gcovr
+#   GCOV       - The gcov tool
+#   BASE_DIR   - The base directory of the sources
+#
+cmake_minimum_required(VERSION 3.10)
+
+function(run_coverage_tool)
+    execute_process(COMMAND ${ARGN} RESULT_VARIABLE RESULT OUTPUT_QUIET)
+    if (NOT RESULT EQUAL 0)
+        string(REPLACE ";" " " COMMAND_LINE "${ARGN}")
+        message(FATAL_ERROR "Coverage command failed: ${COMMAND_LINE}")
+    endif ()
+endfunction()
+
+# Writes the files covered by a test to <capture>.sources, as lines of "<target>\t<file>"
+function(write_covered_sources capture)
+    set(SOURCES)
+    if (BACKEND STREQUAL "gcovr")
+        # gcovr's files are relative to the base directory
+        file(STRINGS ${capture} RECORDS REGEX "\"file\" *: *\"[^\"]+\"")
+        foreach (RECORD ${RECORDS})
+            string(REGEX MATCHALL "\"file\" *: *\"[^\"]+\"" FILES "${RECORD}")
+            foreach (FILE ${FILES})
+                string(REGEX REPLACE "\"file\" *: *\"([^\"]+)\"" "\\1" FILE "${FILE}")
+                get_filename_component(FILE ${FILE} ABSOLUTE BASE_DIR ${BASE_DIR})
+                list(APPEND SOURCES ${FILE})
+            endforeach ()
+        endforeach ()
+    else ()
+        # Only files with at least one line hit
+        file(STRINGS ${capture} RECORDS REGEX "^(SF|LH):")
+        set(SOURCE)
+        foreach (RECORD ${RECORDS})
+            if (RECORD MATCHES "^SF:(.*)$")
+                set(SOURCE ${CMAKE_MATCH_1})
+            elseif (RECORD MATCHES "^LH:([0-9]+)$" AND CMAKE_MATCH_1 GREATER 0 AND SOURCE)
+                list(APPEND SOURCES ${SOURCE})
+            endif ()
+        endforeach ()
+    endif ()
+    set(LINES "")
+    foreach (SOURCE ${SOURCES})
+        string(APPEND LINES "${TARGET}\t${SOURCE}\n")
+    endforeach ()
+    file(WRITE ${capture}.sources "${LINES}")
+endfunction()
+
+function(capture_coverage)
+    # gcov looks for a .gcno file next to its .gcda file
+    file(MAKE_DIRECTORY ${DATA_DIR})
+    file(GLOB_RECURSE NOTES RELATIVE ${BUILD_DIR} ${OBJECT_DIR}/*.gcno)
+    foreach (NOTE ${NOTES})
+        get_filename_component(NOTE_DIR ${NOTE} DIRECTORY)
+        file(COPY ${BUILD_DIR}/${NOTE} DESTINATION ${DATA_DIR}/${NOTE_DIR})
+    endforeach ()
+    file(GLOB_RECURSE DATA ${DATA_DIR}/*.gcda)
+
+    if (BACKEND STREQUAL "gcovr")
+        run_coverage_tool(${TOOL} --gcov-executable ${GCOV} --root ${BASE_DIR} --json ${OUTPUT} ${DATA_DIR})
+        write_covered_sources(${OUTPUT})
+        return()
+    endif ()
+
+    # The baseline makes files the test never ran show up in the report
+    run_coverage_tool(${TOOL} --quiet --gcov-tool ${GCOV} --capture --initial
+            --directory ${DATA_DIR} --base-directory ${BASE_DIR} --output-file ${OUTPUT}.base)
+    if (NOT DATA)
+        file(RENAME ${OUTPUT}.base ${OUTPUT})
+        write_covered_sources(${OUTPUT})
+        return()
+    endif ()
+    run_coverage_tool(${TOOL} --quiet --gcov-tool ${GCOV} --capture
+            --directory ${DATA_DIR} --base-directory ${BASE_DIR} --output-file ${OUTPUT}.run)
+    run_coverage_tool(${TOOL} --quiet --gcov-tool ${GCOV}
+            --add-tracefile ${OUTPUT}.base --add-tracefile ${OUTPUT}.run --output-file ${OUTPUT})
+    write_covered_sources(${OUTPUT}.run)
+    file(RENAME ${OUTPUT}.run.sources ${OUTPUT}.sources)
+endfunction()
+
+function(merge_coverage)
+    string(REPLACE "|" ";" EXCLUDE_LIST "${EXCLUDES}")
+    file(MAKE_DIRECTORY ${REPORT_DIR})
+
+    file(GLOB SOURCES_FILES ${DATA_DIR}/*.sources)
+    set(SOURCES "")
+    foreach (SOURCES_FILE ${SOURCES_FILES})
+        file(READ ${SOURCES_FILE} TEST_SOURCES)
+        string(APPEND SOURCES "${TEST_SOURCES}")
+    endforeach ()
+    file(WRITE ${SOURCES_MAP} "${SOURCES}")
+
+    if (BACKEND STREQUAL "gcovr")
+        file(GLOB CAPTURES ${DATA_DIR}/*.json)
+        set(ARGUMENTS)
+        foreach (CAPTURE ${CAPTURES})
+            list(APPEND ARGUMENTS --add-tracefile ${CAPTURE})
+        endforeach ()
+        foreach (EXCLUDE ${EXCLUDE_LIST})
+            list(APPEND ARGUMENTS --exclude ${EXCLUDE})
+        endforeach ()
+        run_coverage_tool(${TOOL} --root ${BASE_DIR} ${ARGUMENTS} --html-details ${REPORT_DIR}/index.html)
+        return()
+    endif ()
+
+    file(GLOB CAPTURES ${DATA_DIR}/*.info)
+    set(ARGUMENTS)
+    foreach (CAPTURE ${CAPTURES})
+        list(APPEND ARGUMENTS --add-tracefile ${CAPTURE})
+    endforeach ()
+    run_coverage_tool(${TOOL} --quiet --gcov-tool ${GCOV} ${ARGUMENTS} --output-file ${OUTPUT}.total)
+    run_coverage_tool(${TOOL} --quiet --gcov-tool ${GCOV} --remove ${OUTPUT}.total ${EXCLUDE_LIST} --output-file ${OUTPUT})
+    set(GENHTML_ARGUMENTS)
+    if (DEMANGLE)
+        list(APPEND GENHTML_ARGUMENTS --demangle-cpp)
+    endif ()
+    run_coverage_tool(${GENHTML} --quiet ${GENHTML_ARGUMENTS} --output-directory ${REPORT_DIR} ${OUTPUT})
+endfunction()
+
+if (MODE STREQUAL "capture")
+    capture_coverage()
+elseif (MODE STREQUAL "merge")
+    merge_coverage()
+else ()
+    message(FATAL_ERROR "Unknown coverage mode '${MODE}'")
+endif ()
@@ -0,0 +1,109 @@
+# Test Times
+# ~~~~~~~~~~
+# Run by the `all_tests` and `update_test_times_baseline` targets in script mode (cmake -P).
+#
+# Comparing (MODE=compare):
+#   Compares the wall time of each test in RESULTS to the same test in BASELINE, and reports the tests that got
+#   slower by more than THRESHOLD percent. Tests that took less than MIN_TIME milliseconds in the baseline are
+#   too noisy to compare, and are skipped. Tests missing from the baseline are reported, but aren't regressions.
+#   If ACTION is FAIL, the script fails on regressions. Otherwise, it only warns.
+#
+# Updating (MODE=update):
+#   Copies RESULTS to BASELINE.
+#
+#   RESULTS   - The latest results, a line of JSON per test, as written by test_resources.hpp
+#   BASELINE  - The stored results
+#   THRESHOLD - The slowdown, in percent, reported as a regression
+#   MIN_TIME  - The shortest wall time, in milliseconds, that's compared
+#   ACTION    - FAIL or WARN
+#
+cmake_minimum_required(VERSION 3.10)
+
+# Reads the tests of a results file, setting <prefix>_NAMES to their names (<executable>:<suite>.<test>),
+# and <prefix>_<name>_WALL, <prefix>_<name>_CPU and <prefix>_<name>_RSS to their wall time and CPU time in
+# microseconds, and their peak RSS in kilobytes. A test that ran more than once keeps its last results.
+function(read_test_results file prefix)
+    file(STRINGS ${file} LINES)
+    set(NAMES)
+    foreach (LINE ${LINES})
+        string(JSON EXECUTABLE ERROR_VARIABLE ERROR GET "${LINE}" executable)
+        if (ERROR)
+            continue()
+        endif ()
+        string(JSON TEST GET "${LINE}" test)
+        set(NAME ${EXECUTABLE}:${TEST})
+        if (NOT NAME IN_LIST NAMES)
+            list(APPEND NAMES ${NAME})
+        endif ()
+        string(JSON WALL GET "${LINE}" wall_us)
+        string(JSON CPU GET "${LINE}" cpu_us)
+        string(JSON RSS GET "${LINE}" peak_rss_kb)
+        set(${prefix}_${NAME}_WALL ${WALL} PARENT_SCOPE)
+        set(${prefix}_${NAME}_CPU ${CPU} PARENT_SCOPE)
+        set(${prefix}_${NAME}_RSS ${RSS} PARENT_SCOPE)
+    endforeach ()
+    set(${prefix}_NAMES ${NAMES} PARENT_SCOPE)
+endfunction()
+
+function(compare_test_times)
+    if (CMAKE_VERSION VERSION_LESS 3.19)
+        message(WARNING "Comparing test times requires CMake 3.19 or newer, ${RESULTS} wasn't compared")
+        return()
+    endif ()
+    if (NOT EXISTS ${RESULTS})
+        message(STATUS "No test times in ${RESULTS}")
+        return()
+    endif ()
+    if (NOT EXISTS ${BASELINE})
+        message(STATUS "No test times baseline, run the update_test_times_baseline target to store one")
+        return()
+    endif ()
+    read_test_results(${RESULTS} CURRENT)
+    read_test_results(${BASELINE} BASELINE)
+    math(EXPR MIN_TIME_US "${MIN_TIME} * 1000")
+    set(REGRESSIONS 0)
+    foreach (NAME ${CURRENT_NAMES})
+        if (NOT NAME IN_LIST BASELINE_NAMES)
+            message(STATUS "${NAME}: no baseline")
+            continue()
+        endif ()
+        set(CURRENT ${CURRENT_${NAME}_WALL})
+        set(BASELINE_TIME ${BASELINE_${NAME}_WALL})
+        if (BASELINE_TIME LESS MIN_TIME_US OR BASELINE_TIME EQUAL 0)
+            continue()
+        endif ()
+        math(EXPR CHANGE "(${CURRENT} - ${BASELINE_TIME}) * 100 / ${BASELINE_TIME}")
+        set(DETAILS "${CURRENT}us wall, ${CURRENT_${NAME}_CPU}us CPU, ${CURRENT_${NAME}_RSS}KB peak RSS")
+        if (CHANGE GREATER THRESHOLD)
+            message(STATUS "${NAME}: ${CHANGE}% slower than the baseline, ${DETAILS} (REGRESSION)")
+            math(EXPR REGRESSIONS "${REGRESSIONS} + 1")
+        else ()
+            message(STATUS "${NAME}: ${CHANGE}% change from the baseline, ${DETAILS}")
+        endif ()
+    endforeach ()
+    if (REGRESSIONS GREATER 0)
+        set(SUMMARY "${REGRESSIONS} tests got slower by more than ${THRESHOLD}%")
+        if (ACTION STREQUAL "FAIL")
+            message(FATAL_ERROR "${SUMMARY}")
+        endif ()
+        message(WARNING "${SUMMARY}")
+    endif ()
+endfunction()
+
+function(update_test_times_baseline)
+    if (NOT EXISTS ${RESULTS})
+        message(FATAL_ERROR "No test times in ${RESULTS}, run the all_tests target first")
+    endif ()
+    get_filename_component(BASELINE_DIR ${BASELINE} DIRECTORY)
+    file(MAKE_DIRECTORY ${BASELINE_DIR})
+    configure_file(${RESULTS} ${BASELINE} COPYONLY)
+    message(STATUS "Test times baseline updated in ${BASELINE}")
+endfunction()
+
+if (MODE STREQUAL "compare")
+    compare_test_times()
+elseif (MODE STREQUAL "update")
+    update_test_times_baseline()
+else ()
+    message(FATAL_ERROR "Unknown test times mode '${MODE}'")
+endif ()
@@ -0,0 +1,287 @@
+/********************************************************************
+	File name:	alloc_tracker.hpp
+	Project  :	Cutie
+	Author   :	Dor Cohen
+
+    Counts the calls to malloc, calloc, realloc and free, by hooking
+    them with stubs that bump atomic counters and call the original
+    functions through their trampolines.
+    Subhook can't build trampolines for some of glibc's functions (free()
+    starts with a relative jump). calloc() is then emulated by malloc(),
+    and realloc() and free() aren't hooked, so they aren't counted.
+    The stubs never allocate, and never remove their hooks, so they
+    don't recurse, and are safe to call from any thread.
+    Only used internally by CUTIE_TRACK_ALLOCATIONS,
+    EXPECT_MAX_ALLOCATIONS and EXPECT_MAX_BYTES.
+
+********************************************************************/
+#ifndef CUTIE_ALLOC_TRACKER_HPP
+#define CUTIE_ALLOC_TRACKER_HPP
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <dlfcn.h>
+#include <gtest/gtest.h>
+#include "hook_registry.hpp"
+
+namespace cutie {
+
+    /********************************************************************
+        The process-wide allocation hooks.
+        Installed while at least one CAllocationScope exists.
+        Allocations are counted in all threads.
+    ********************************************************************/
+    class CAllocationTracker {
+    private:
+        typedef void* (* Malloc)(size_t);
+        typedef void* (* Calloc)(size_t, size_t);
+        typedef void* (* Realloc)(void*, size_t);
+        typedef void (* Free)(void*);
+
+        static constexpr size_t g_functions = 4;
+
+        static inline Malloc s_malloc = nullptr;
+        static inline Calloc s_calloc = nullptr;
+        static inline Realloc s_realloc = nullptr;
+        static inline Free s_free = nullptr;
+
+        static inline std::atomic<uint64_t> s_allocations{0};
+        static inline std::atomic<uint64_t> s_bytes{0};
+        static inline std::atomic<uint64_t> s_frees{0};
+
+        std::mutex m_mutex;
+        size_t m_users;
+        // The hooks installed while tracking, of the functions that can be hooked
+        size_t m_count;
+        SitePatch m_patches[g_functions];
+
+    public:
+        // Never destroyed, as allocations may still be made during static destruction
+        static CAllocationTracker& Instance() {
+            static CAllocationTracker* instance = new CAllocationTracker();
+            return *instance;
+        }
+
+        uint64_t allocations() const { return s_allocations.load(std::memory_order_relaxed); }
+
+        uint64_t bytes() const { return s_bytes.load(std::memory_order_relaxed); }
+
+        uint64_t frees() const { return s_frees.load(std::memory_order_relaxed); }
+
+        // Whether calls to free() are counted. They aren't if Subhook can't build a trampoline for free().
+        bool counts_frees() const { return nullptr != s_free; }
+
+        /********************************************************************
+            @brief Install the hooks, if this is the first user.
+
+            @return false if the hooks can't be installed, as Subhook
+                can't build a trampoline for malloc(), or the functions'
+                code can't be patched
+        ********************************************************************/
+        bool Acquire() {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (0 == m_count) {
+                return false;
+            }
+            if ((0 == m_users) && !CHookSite::PatchAll(m_patches, m_count)) {
+                return false;
+            }
+            ++m_users;
+            return true;
+        }
+
+        // Remove the hooks, if this is the last user
+        void Release() {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (0 == --m_users) {
+                SitePatch patches[g_functions];
+                for (size_t i = 0; i < m_count; ++i) {
+                    patches[i] = {m_patches[i].site, nullptr};
+                }
+                CHookSite::PatchAll(patches, m_count);
+            }
+        }
+
+    private:
+        CAllocationTracker() : m_users(0), m_count(0), m_patches() {
+            // Without malloc(), nothing is tracked
+            void* original = nullptr;
+            CHookSite* site = Find("malloc", &original);
+            if (nullptr == original) {
+                return;
+            }
+            // Set before the stubs are ever installed, as they call straight through them
+            s_malloc = (Malloc) original;
+            m_patches[m_count++] = {site, (void*) MallocStub};
+
+            // calloc() is emulated by malloc() if it can't be called through a trampoline
+            site = Find("calloc", &original);
+            s_calloc = (Calloc) original;
+            if (nullptr != site) {
+                m_patches[m_count++] = {site, (void*) CallocStub};
+            }
+
+            // Neither can be emulated, so they're left alone if they can't be called through a trampoline
+            site = Find("realloc", &original);
+            s_realloc = (Realloc) original;
+            if (nullptr != original) {
+                m_patches[m_count++] = {site, (void*) ReallocStub};
+            }
+            site = Find("free", &original);
+            s_free = (Free) original;
+            if (nullptr != original) {
+                m_patches[m_count++] = {site, (void*) FreeStub};
+            }
+        }
+
+        /********************************************************************
+            @brief Find the site of an allocation function.
+
+            @param name [IN] The function's name
+            @param trampoline [OUT] The function's trampoline, or nullptr
+                if Subhook can't build one
+            @return The site, or nullptr if the function doesn't exist
+        ********************************************************************/
+        static CHookSite* Find(const char* name, void** trampoline) {
+            *trampoline = nullptr;
+            // The function's real address, rather than the executable's PLT entry for it
+            void* function = dlsym(RTLD_NEXT, name);
+            if (nullptr == function) {
+                function = dlsym(RTLD_DEFAULT, name);
+            }
+            if (nullptr == function) {
+                return nullptr;
+            }
+            CHookSite* site = &CHookRegistry::Instance().Acquire(function);
+            *trampoline = site->trampoline();
+            return site;
+        }
+
+        static void* MallocStub(size_t size) {
+            s_allocations.fetch_add(1, std::memory_order_relaxed);
+            s_bytes.fetch_add(size, std::memory_order_relaxed);
+            return s_malloc(size);
+        }
+
+        static void* CallocStub(size_t count, size_t size) {
+            s_allocations.fetch_add(1, std::memory_order_relaxed);
+            size_t total = 0;
+            if (__builtin_mul_overflow(count, size, &total)) {
+                errno = ENOMEM;
+                return nullptr;
+            }
+            s_bytes.fetch_add(total, std::memory_order_relaxed);
+            if (nullptr != s_calloc) {
+                return s_calloc(count, size);
+            }
+            void* memory = s_malloc(total);
+            if (nullptr != memory) {
+                std::memset(memory, 0, total);
+            }
+            return memory;
+        }
+
+        // Growing or shrinking a block counts as an allocation, as it may move the block
+        static void* ReallocStub(void* memory, size_t size) {
+            s_allocations.fetch_add(1, std::memory_order_relaxed);
+            s_bytes.fetch_add(size, std::memory_order_relaxed);
+            return s_realloc(memory, size);
+        }
+
+        static void FreeStub(void* memory) {
+            if (nullptr != memory) {
+                s_frees.fetch_add(1, std::memory_order_relaxed);
+            }
+            s_free(memory);
+        }
+
+        CAllocationTracker(const CAllocationTracker&) = delete;
+        CAllocationTracker& operator=(const CAllocationTracker&) = delete;
+    };
+
+    /********************************************************************
+        Counts the allocations made by all threads during its lifetime.
+    ********************************************************************/
+    class CAllocationScope {
+    private:
+        bool m_tracking;
+        uint64_t m_allocations;
+        uint64_t m_bytes;
+        uint64_t m_frees;
+
+    public:
+        CAllocationScope() : m_tracking(CAllocationTracker::Instance().Acquire()) {
+            CAllocationTracker& tracker = CAllocationTracker::Instance();
+            m_allocations = tracker.allocations();
+            m_bytes = tracker.bytes();
+            m_frees = tracker.frees();
+        }
+
+        ~CAllocationScope() {
+            if (m_tracking) {
+                CAllocationTracker::Instance().Release();
+            }
+        }
+
+        // Whether allocations are tracked. They aren't if the allocation functions couldn't be hooked.
+        bool is_tracking() const { return m_tracking; }
+
+        uint64_t allocations() const { return CAllocationTracker::Instance().allocations() - m_allocations; }
+
+        uint64_t bytes() const { return CAllocationTracker::Instance().bytes() - m_bytes; }
+
+        uint64_t frees() const { return CAllocationTracker::Instance().frees() - m_frees; }
+
+        bool counts_frees() const { return CAllocationTracker::Instance().counts_frees(); }
+
+    private:
+        CAllocationScope(const CAllocationScope&) = delete;
+        CAllocationScope& operator=(const CAllocationScope&) = delete;
+    };
+
+    /********************************************************************
+        Fails the current test if more than the given allocations or
+        bytes were allocated during its lifetime.
+        Only used internally by EXPECT_MAX_ALLOCATIONS and EXPECT_MAX_BYTES.
+    ********************************************************************/
+    class CScopedAllocationBudget {
+    private:
+        const char* m_file;
+        int m_line;
+        uint64_t m_max_allocations;
+        uint64_t m_max_bytes;
+        CAllocationScope m_scope;
+
+    public:
+        CScopedAllocationBudget(const char* file, int line, uint64_t max_allocations, uint64_t max_bytes)
+                : m_file(file), m_line(line), m_max_allocations(max_allocations), m_max_bytes(max_bytes) {}
+
+        ~CScopedAllocationBudget() {
+            // Read before reporting, as GoogleTest allocates when reporting
+            uint64_t allocations = m_scope.allocations();
+            uint64_t bytes = m_scope.bytes();
+            if (!m_scope.is_tracking()) {
+                ADD_FAILURE_AT(m_file, m_line) << "Allocations can't be tracked, as malloc() can't be hooked or patched";
+                return;
+            }
+            if (allocations > m_max_allocations) {
+                ADD_FAILURE_AT(m_file, m_line) << allocations << " allocations were made, expected at most "
+                                               << m_max_allocations;
+            }
+            if (bytes > m_max_bytes) {
+                ADD_FAILURE_AT(m_file, m_line) << bytes << " bytes were allocated, expected at most " << m_max_bytes;
+            }
+        }
+
+    private:
+        CScopedAllocationBudget(const CScopedAllocationBudget&) = delete;
+        CScopedAllocationBudget& operator=(const CScopedAllocationBudget&) = delete;
+    };
+
+}
+
+#endif //CUTIE_ALLOC_TRACKER_HPP
@@ -0,0 +1,58 @@
+/********************************************************************
+	File name:	auto_mocker.hpp
+	Project  :	Cutie
+	Author   :	Dor Cohen
+
+    A mocker whose mock method and stub are generated from the
+    function's signature, as deduced from decltype(func).
+    Built on GMock's MockFunction, so the number of parameters doesn't
+    have to be given, and the legacy MOCK_METHODn and
+    CMOCK_MOCK_FUNCTIONn macros aren't expanded for every function.
+    Only used internally by DECLARE_AUTO_MOCKABLE.
+
+********************************************************************/
+#ifndef CUTIE_AUTO_MOCKER_HPP
+#define CUTIE_AUTO_MOCKER_HPP
+
+#include <utility>
+#include <gmock/gmock.h>
+#include "function_traits.hpp"
+
+namespace cutie {
+
+    template<typename Tag, typename Signature>
+    class CAutoMocker;
+
+    /********************************************************************
+        Tag - A type unique to the mocked function
+    ********************************************************************/
+    template<typename Tag, typename R, typename... Args>
+    class CAutoMocker<Tag, R(Args...)> : public ::testing::MockFunction<R(Args...)> {
+    private:
+        static inline CAutoMocker* s_instance = nullptr;
+
+        CAutoMocker* m_previous_instance;
+
+    protected:
+        CAutoMocker() : m_previous_instance(s_instance) {
+            s_instance = this;
+        }
+
+        ~CAutoMocker() {
+            s_instance = m_previous_instance;
+        }
+
+    public:
+        // Installed in place of the mocked function. Forwards the call to the latest mocker.
+        static R Stub(Args... args) {
+            return s_instance->Call(std::forward<Args>(args)...);
+        }
+
+    private:
+        CAutoMocker(const CAutoMocker&) = delete;
+        CAutoMocker& operator=(const CAutoMocker&) = delete;
+    };
+
+}
+
+#endif //CUTIE_AUTO_MOCKER_HPP
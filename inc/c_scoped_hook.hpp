@@ -6,44 +6,65 @@
     Reimplements Subhook's ScopedHookInstall and ScopedHookRemove using Subhook's
     C interface, because the provided classes don't support replacing stubs.
 
+    The hooks are kept in the process-wide CHookRegistry, so the trampoline of a
+    function is created only once. Installing, replacing and removing a hook only
+    rewrites the jump in the function's prologue.
+    If the jump can't be written (see code_patcher.hpp), installing and
+    replacing hooks throw std::runtime_error, so the test never runs
+    against the original function by mistake. Removing hooks can't throw.
+
 ********************************************************************/
 #ifndef CUTIE_C_SCOPED_HOOK_HPP
 #define CUTIE_C_SCOPED_HOOK_HPP
 
-#include <subhook.h>
+#include <stdexcept>
+#include <vector>
+#include "hook_registry.hpp"
 
 namespace cutie {
 
-#if defined SUBHOOK_X86_64
-    static subhook_flags_t g_subhook_flags = SUBHOOK_64BIT_OFFSET;
-#elif defined SUBHOOK_X86
-    static subhook_flags_t g_subhook_flags = 0;
-#else
-#error Unsupported bitness
-#endif
-
     class CScopedHookInstall {
     private:
         subhook_t* m_hook;
         void* m_src;
+        CHookSite* m_site;
 
     public:
+        // If dst is nullptr, the hook isn't installed until Replace() is called
         CScopedHookInstall(subhook_t* hook, void* src, void* dst)
-                : m_src(src), m_hook(hook) {
-            *m_hook = subhook_new(m_src, dst, (subhook_flags_t) g_subhook_flags);
-            subhook_install(*m_hook);
+                : m_hook(hook), m_src(src), m_site(nullptr) {
+            if (nullptr != dst) {
+                Replace(dst);
+            }
+        }
+
+        // The function's site, acquired on first use without patching the function
+        CHookSite& site() {
+            if (nullptr == m_site) {
+                m_site = &CHookRegistry::Instance().Acquire(m_src);
+                *m_hook = m_site->handle();
+            }
+            return *m_site;
         }
 
+        // If a newer hook is installed on the same function, dst only takes place once that hook is removed
         void Replace(void* dst) {
-            subhook_remove(*m_hook);
-            subhook_free(*m_hook);
-            *m_hook = subhook_new(m_src, dst, (subhook_flags_t) g_subhook_flags);
-            subhook_install(*m_hook);
+            if (!site().Install(this, dst)) {
+                throw std::runtime_error("Can't install the hook, the function's code can't be patched");
+            }
         }
 
+        // Restores whatever was installed before this hook. A later Replace() installs it again.
+        void Remove() {
+            if (nullptr != m_site) {
+                m_site->Remove(this);
+                m_site = nullptr;
+            }
+        }
+
+        // Nested hooks on the same function unwind properly, even if they aren't destroyed in reverse order
         ~CScopedHookInstall() {
-            subhook_remove(*m_hook);
-            subhook_free(*m_hook);
+            Remove();
         }
 
     private:
@@ -53,16 +74,25 @@ namespace cutie {
 
     class CScopedHookRemove {
     private:
-        subhook_t* m_hook;
+        CHookSite* m_site;
+        void* m_dst;
 
     public:
         CScopedHookRemove(subhook_t* hook)
-                : m_hook(hook) {
-            subhook_remove(*m_hook);
+                : m_site(nullptr), m_dst(nullptr) {
+            if (nullptr != *hook) {
+                m_site = CHookRegistry::Instance().Find(Source(*hook));
+            }
+            if (nullptr != m_site) {
+                m_dst = m_site->dst();
+                m_site->Patch(nullptr);
+            }
         }
 
         ~CScopedHookRemove() {
-            subhook_install(*m_hook);
+            if (nullptr != m_site) {
+                m_site->Patch(m_dst);
+            }
         }
 
     private:
@@ -70,6 +100,90 @@ namespace cutie {
         CScopedHookRemove& operator=(const CScopedHookRemove&);
     };
 
+    /********************************************************************
+        A set of hooks that are installed together, and removed together
+        when the set goes out of scope.
+        All the patches are written as a single batch: page protection is
+        changed once per page and the instruction cache is flushed once,
+        instead of once per hook.
+    ********************************************************************/
+    class CScopedHookSet {
+    private:
+        struct Entry {
+            subhook_t* hook;
+            void* src;
+            void* dst;
+            CHookSite* site;
+            void* previous_dst;
+        };
+
+        std::vector<Entry> m_entries;
+        size_t m_installed;
+
+    public:
+        CScopedHookSet() : m_installed(0) {}
+
+        /********************************************************************
+            @brief Add a hook to the set. The hook takes place on Install().
+
+            @param hook [OUT] Receives the hook's handle. May be nullptr.
+            @param src [IN] The function to place a hook on
+            @param dst [IN] The function that will be called
+        ********************************************************************/
+        void Add(subhook_t* hook, void* src, void* dst) {
+            m_entries.push_back({hook, src, dst, nullptr, nullptr});
+        }
+
+        void Add(void* src, void* dst) {
+            Add(nullptr, src, dst);
+        }
+
+        // Install all hooks added since the last call to Install(). On failure, none of them is installed.
+        void Install() {
+            CHookRegistry& registry = CHookRegistry::Instance();
+            std::lock_guard<std::recursive_mutex> lock(CCodePatcher::Instance().mutex());
+            std::vector<SitePatch> patches;
+            for (size_t i = m_installed; i < m_entries.size(); ++i) {
+                Entry& entry = m_entries[i];
+                entry.site = &registry.Acquire(entry.src);
+                if (nullptr != entry.hook) {
+                    *entry.hook = entry.site->handle();
+                }
+                patches.push_back({entry.site, entry.dst});
+            }
+            // Each entry restores what was installed before it, including by entries earlier in the set
+            ComputePreviousDestinations();
+            if (!CHookSite::PatchAll(patches.data(), patches.size())) {
+                throw std::runtime_error("Can't install the hook set, the functions' code can't be patched");
+            }
+            m_installed = m_entries.size();
+        }
+
+        ~CScopedHookSet() {
+            std::vector<SitePatch> patches;
+            for (size_t i = m_installed; i > 0; --i) {
+                patches.push_back({m_entries[i - 1].site, m_entries[i - 1].previous_dst});
+            }
+            CHookSite::PatchAll(patches.data(), patches.size());
+        }
+
+    private:
+        void ComputePreviousDestinations() {
+            for (size_t i = m_installed; i < m_entries.size(); ++i) {
+                Entry& entry = m_entries[i];
+                entry.previous_dst = entry.site->dst();
+                for (size_t j = m_installed; j < i; ++j) {
+                    if (m_entries[j].site == entry.site) {
+                        entry.previous_dst = m_entries[j].dst;
+                    }
+                }
+            }
+        }
+
+        CScopedHookSet(const CScopedHookSet&) = delete;
+        CScopedHookSet& operator=(const CScopedHookSet&) = delete;
+    };
+
 }
 
 #endif //CUTIE_C_SCOPED_HOOK_HPP
@@ -0,0 +1,409 @@
+/********************************************************************
+	File name:	call_log.hpp
+	Project  :	Cutie
+	Author   :	Dor Cohen
+
+    A compact binary log of the calls to a single function, as written
+    by CUTIE_RECORD and read by CUTIE_REPLAY.
+    The log is append-only, and memory-mapped both when writing and
+    when reading, so a call costs a copy into the mapping rather than a
+    system call. If the recording process crashes, every call appended
+    before the crash is still in the file.
+
+    The log's file is accessed through raw system calls, as the
+    functions recorded or replayed (such as open() or mmap()) are
+    mocked while it's written or read.
+
+    Layout (native byte order, as logs are replayed on the recording
+    machine's architecture):
+        Header:   "CUTIELOG", u32 version, u32 arity,
+                  then per argument: u32 kind, u32 size argument
+        Records:  u32 size of the rest of the record, u32 errno,
+                  u32 result size, result,
+                  then per argument: u32 size, bytes
+        A record size of 0 ends the log.
+
+********************************************************************/
+#ifndef CUTIE_CALL_LOG_HPP
+#define CUTIE_CALL_LOG_HPP
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace cutie {
+
+    // The file operations of the logs, bypassing the (possibly mocked) C library functions
+    namespace raw {
+        inline int Open(const char* path, int flags, mode_t mode = 0) {
+            return (int) syscall(SYS_openat, AT_FDCWD, path, flags, mode);
+        }
+
+        inline int Close(int fd) {
+            return (int) syscall(SYS_close, fd);
+        }
+
+        inline off_t Size(int fd) {
+            return (off_t) syscall(SYS_lseek, fd, (off_t) 0, SEEK_END);
+        }
+
+        inline int Truncate(int fd, off_t size) {
+            return (int) syscall(SYS_ftruncate, fd, size);
+        }
+
+        inline void* Map(size_t size, int protection, int flags, int fd) {
+            return (void*) syscall(SYS_mmap, nullptr, size, protection, flags, fd, (off_t) 0);
+        }
+
+        inline void* Remap(void* data, size_t old_size, size_t new_size) {
+            return (void*) syscall(SYS_mremap, data, old_size, new_size, MREMAP_MAYMOVE);
+        }
+
+        inline int Unmap(const void* data, size_t size) {
+            return (int) syscall(SYS_munmap, data, size);
+        }
+    }
+
+    // The size argument of OutputBuffer() for buffers the function fills entirely, such as stat()'s
+    constexpr uint32_t g_pointee_size = UINT32_MAX;
+
+    /********************************************************************
+        How an argument is recorded.
+    ********************************************************************/
+    struct RecordedArgument {
+        enum Kind : uint32_t {
+            // The argument's own bytes. Pointers are recorded by whether they're null.
+            Value,
+            // The bytes a pointer points to, before the call, as many as the size argument
+            InputBuffer,
+            // The bytes a pointer points to, after the call. As many as the result, for functions returning
+            // the number of bytes they wrote (such as read()), but never more than the size argument.
+            OutputBuffer,
+            // The argument's own bytes, which aren't compared on replay, such as file descriptors
+            Unchecked,
+        };
+
+        uint32_t argument;
+        Kind kind;
+        uint32_t size_argument;
+    };
+
+    /********************************************************************
+        @brief Record the bytes an argument points to, before the call.
+            For example, InputBuffer(1, 2) for write(fd, buffer, size).
+
+        @param argument [IN] The index of the pointer argument, starting from 0
+        @param size_argument [IN] The index of the argument giving its size in bytes
+    ********************************************************************/
+    inline RecordedArgument InputBuffer(uint32_t argument, uint32_t size_argument) {
+        return {argument, RecordedArgument::InputBuffer, size_argument};
+    }
+
+    /********************************************************************
+        @brief Record the bytes an argument points to, after the call,
+            and write them to it on replay.
+            For example, OutputBuffer(1, 2) for read(fd, buffer, size),
+            or OutputBuffer(1) for stat(path, buffer).
+
+        @param argument [IN] The index of the pointer argument, starting from 0
+        @param size_argument [IN] The index of the argument giving its size in
+            bytes. If omitted, the size of the pointed type.
+    ********************************************************************/
+    inline RecordedArgument OutputBuffer(uint32_t argument, uint32_t size_argument = g_pointee_size) {
+        return {argument, RecordedArgument::OutputBuffer, size_argument};
+    }
+
+    /********************************************************************
+        @brief Record an argument without comparing it on replay, for
+            arguments that differ between runs, such as file descriptors.
+
+        @param argument [IN] The index of the argument, starting from 0
+    ********************************************************************/
+    inline RecordedArgument UncheckedArgument(uint32_t argument) {
+        return {argument, RecordedArgument::Unchecked, 0};
+    }
+
+    struct LogSpan {
+        const uint8_t* data;
+        uint32_t size;
+    };
+
+    /********************************************************************
+        A recorded call, pointing into the log's mapping.
+    ********************************************************************/
+    struct LoggedCall {
+        int error;
+        LogSpan result;
+        std::vector<LogSpan> arguments;
+    };
+
+    constexpr char g_call_log_magic[8] = {'C', 'U', 'T', 'I', 'E', 'L', 'O', 'G'};
+    constexpr uint32_t g_call_log_version = 1;
+
+    /********************************************************************
+        Appends calls to a new log.
+        Not thread-safe.
+    ********************************************************************/
+    class CCallLogWriter {
+    private:
+        static constexpr size_t g_initial_capacity = 64 * 1024;
+
+        int m_fd;
+        uint8_t* m_data;
+        size_t m_size;
+        size_t m_capacity;
+
+    public:
+        CCallLogWriter() : m_fd(-1), m_data(nullptr), m_size(0), m_capacity(0) {}
+
+        ~CCallLogWriter() {
+            Close();
+        }
+
+        /********************************************************************
+            @brief Create the log, replacing an existing one.
+
+            @param path [IN] The log's path
+            @param arguments [IN] How each of the function's arguments is recorded
+            @return false if the file can't be created
+        ********************************************************************/
+        bool Open(const std::string& path, const std::vector<RecordedArgument>& arguments) {
+            m_fd = raw::Open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (-1 == m_fd || !Reserve(g_initial_capacity)) {
+                Close();
+                return false;
+            }
+            Append(g_call_log_magic, sizeof(g_call_log_magic));
+            AppendU32(g_call_log_version);
+            AppendU32((uint32_t) arguments.size());
+            for (const RecordedArgument& argument : arguments) {
+                AppendU32(argument.kind);
+                AppendU32(argument.size_argument);
+            }
+            return true;
+        }
+
+        bool is_open() const { return nullptr != m_data; }
+
+        /********************************************************************
+            @brief Append a record. The record is built by the caller, see
+                the layout above, excluding the leading size.
+                The size is written after the record, so if the process
+                crashes in between, the log ends at the zeros where the
+                size should be.
+        ********************************************************************/
+        void AppendRecord(const std::vector<uint8_t>& record) {
+            uint32_t size = (uint32_t) record.size();
+            if (!Reserve(m_size + sizeof(size) + record.size())) {
+                return;
+            }
+            std::memcpy(m_data + m_size + sizeof(size), record.data(), record.size());
+            std::atomic_thread_fence(std::memory_order_release);
+            AppendU32(size);
+            m_size += record.size();
+        }
+
+        // Truncate the file to the appended calls
+        void Close() {
+            if (nullptr != m_data) {
+                raw::Unmap(m_data, m_capacity);
+                m_data = nullptr;
+            }
+            if (-1 != m_fd) {
+                // If truncating fails, the zeros after the appended calls end the log anyway
+                (void) raw::Truncate(m_fd, (off_t) m_size);
+                raw::Close(m_fd);
+                m_fd = -1;
+            }
+            m_size = 0;
+            m_capacity = 0;
+        }
+
+        static void AppendU32(std::vector<uint8_t>& buffer, uint32_t value) {
+            const uint8_t* bytes = (const uint8_t*) &value;
+            buffer.insert(buffer.end(), bytes, bytes + sizeof(value));
+        }
+
+        // Appends the size of the bytes, then the bytes themselves
+        static void AppendSpan(std::vector<uint8_t>& buffer, const void* data, size_t size) {
+            AppendU32(buffer, (uint32_t) size);
+            const uint8_t* bytes = (const uint8_t*) data;
+            buffer.insert(buffer.end(), bytes, bytes + size);
+        }
+
+    private:
+        // Grow the file and its mapping, doubling them, to fit the given size
+        bool Reserve(size_t size) {
+            if (size <= m_capacity) {
+                return true;
+            }
+            size_t capacity = (0 == m_capacity) ? g_initial_capacity : m_capacity;
+            while (capacity < size) {
+                capacity *= 2;
+            }
+            if (0 != raw::Truncate(m_fd, (off_t) capacity)) {
+                return false;
+            }
+            void* data = (nullptr == m_data)
+                         ? raw::Map(capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd)
+                         : raw::Remap(m_data, m_capacity, capacity);
+            if (MAP_FAILED == data) {
+                return false;
+            }
+            m_data = (uint8_t*) data;
+            m_capacity = capacity;
+            return true;
+        }
+
+        void Append(const void* data, size_t size) {
+            std::memcpy(m_data + m_size, data, size);
+            m_size += size;
+        }
+
+        void AppendU32(uint32_t value) {
+            Append(&value, sizeof(value));
+        }
+
+        CCallLogWriter(const CCallLogWriter&) = delete;
+        CCallLogWriter& operator=(const CCallLogWriter&) = delete;
+    };
+
+    /********************************************************************
+        Reads the calls of a log, in the order they were recorded.
+        Not thread-safe.
+    ********************************************************************/
+    class CCallLogReader {
+    private:
+        const uint8_t* m_data;
+        size_t m_size;
+        size_t m_offset;
+        std::vector<RecordedArgument> m_arguments;
+
+    public:
+        CCallLogReader() : m_data(nullptr), m_size(0), m_offset(0) {}
+
+        ~CCallLogReader() {
+            if (nullptr != m_data) {
+                raw::Unmap(m_data, m_size);
+            }
+        }
+
+        /********************************************************************
+            @brief Map a log written by CCallLogWriter.
+
+            @param path [IN] The log's path
+            @param error [OUT] What's wrong, if the log can't be read
+            @return false if the file can't be read, or isn't a log
+        ********************************************************************/
+        bool Open(const std::string& path, std::string* error) {
+            int fd = raw::Open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (-1 == fd) {
+                *error = "can't open " + path + ": " + std::strerror(errno);
+                return false;
+            }
+            off_t size = raw::Size(fd);
+            void* data = MAP_FAILED;
+            if (size > 0) {
+                data = raw::Map((size_t) size, PROT_READ, MAP_PRIVATE, fd);
+            }
+            raw::Close(fd);
+            if (MAP_FAILED == data) {
+                *error = "can't map " + path;
+                return false;
+            }
+            m_data = (const uint8_t*) data;
+            m_size = (size_t) size;
+
+            uint32_t version = 0;
+            uint32_t arity = 0;
+            if (m_size < sizeof(g_call_log_magic) ||
+                0 != std::memcmp(m_data, g_call_log_magic, sizeof(g_call_log_magic))) {
+                *error = path + " isn't a call log";
+                return false;
+            }
+            m_offset = sizeof(g_call_log_magic);
+            if (!ReadU32(&version) || g_call_log_version != version || !ReadU32(&arity)) {
+                *error = path + " has an unsupported version";
+                return false;
+            }
+            for (uint32_t i = 0; i < arity; ++i) {
+                uint32_t kind = 0;
+                uint32_t size_argument = 0;
+                if (!ReadU32(&kind) || !ReadU32(&size_argument) || kind > RecordedArgument::Unchecked) {
+                    *error = path + " is truncated";
+                    return false;
+                }
+                m_arguments.push_back({i, (RecordedArgument::Kind) kind, size_argument});
+            }
+            return true;
+        }
+
+        // How each of the function's arguments was recorded
+        const std::vector<RecordedArgument>& arguments() const { return m_arguments; }
+
+        /********************************************************************
+            @brief Read the next call.
+
+            @return false at the end of the log
+        ********************************************************************/
+        bool Next(LoggedCall* call) {
+            uint32_t size = 0;
+            size_t start = m_offset;
+            if (!ReadU32(&size) || 0 == size || m_size - m_offset < size) {
+                m_offset = start;
+                return false;
+            }
+            size_t end = m_offset + size;
+            uint32_t error = 0;
+            call->arguments.clear();
+            bool valid = ReadU32(&error) && ReadSpan(end, &call->result);
+            for (size_t i = 0; valid && i < m_arguments.size(); ++i) {
+                LogSpan argument{};
+                valid = ReadSpan(end, &argument);
+                call->arguments.push_back(argument);
+            }
+            // A record of zeros, left by a crash, has a size but not its spans
+            if (!valid || m_offset != end) {
+                m_offset = start;
+                return false;
+            }
+            call->error = (int) error;
+            m_offset = end;
+            return true;
+        }
+
+    private:
+        bool ReadU32(uint32_t* value) {
+            if (m_size - m_offset < sizeof(*value)) {
+                return false;
+            }
+            std::memcpy(value, m_data + m_offset, sizeof(*value));
+            m_offset += sizeof(*value);
+            return true;
+        }
+
+        bool ReadSpan(size_t end, LogSpan* span) {
+            uint32_t size = 0;
+            if (end - m_offset < sizeof(size) || !ReadU32(&size) || end - m_offset < size) {
+                return false;
+            }
+            *span = {m_data + m_offset, size};
+            m_offset += size;
+            return true;
+        }
+
+        CCallLogReader(const CCallLogReader&) = delete;
+        CCallLogReader& operator=(const CCallLogReader&) = delete;
+    };
+
+}
+
+#endif //CUTIE_CALL_LOG_HPP
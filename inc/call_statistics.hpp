@@ -0,0 +1,277 @@
+/********************************************************************
+	File name:	call_statistics.hpp
+	Project  :	Cutie
+	Author   :	Dor Cohen
+
+    Call statistics of mocks and hooks, to find the ones a slow test
+    spends its time in: per function, the number of calls, the total
+    time spent in its stub (including the original function and nested
+    mocks), and the time spent in the original function, when called
+    through CALL_ORIGINAL or by a recording.
+    They're reported by the listener in call_statistics_listener.hpp.
+    Collected only when CUTIE_CALL_STATISTICS is defined, by the option
+    of the same name in Cutie.cmake, as it times every hooked call.
+
+********************************************************************/
+#ifndef CUTIE_CALL_STATISTICS_HPP
+#define CUTIE_CALL_STATISTICS_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "c_scoped_hook.hpp"
+
+namespace cutie {
+
+    /********************************************************************
+        The statistics of a single mock or hook.
+        Created once per function (or once per test file declaring it),
+        and never destroyed, as it's reported when the tests end.
+    ********************************************************************/
+    class CCallStatistics {
+    public:
+        struct Totals {
+            uint64_t calls;
+            std::chrono::nanoseconds stub;
+            std::chrono::nanoseconds original;
+        };
+
+    private:
+        const char* m_name;
+        const char* m_kind;
+        std::atomic<uint64_t> m_calls;
+        std::atomic<int64_t> m_stub_ns;
+        std::atomic<int64_t> m_original_ns;
+
+    public:
+        CCallStatistics(const char* name, const char* kind);
+
+        const char* name() const { return m_name; }
+
+        // "mock" or "hook"
+        const char* kind() const { return m_kind; }
+
+        template<typename Duration>
+        void AddCall(Duration duration) {
+            m_calls.fetch_add(1, std::memory_order_relaxed);
+            m_stub_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(),
+                                std::memory_order_relaxed);
+        }
+
+        template<typename Duration>
+        void AddOriginal(Duration duration) {
+            m_original_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(),
+                                    std::memory_order_relaxed);
+        }
+
+        Totals totals() const {
+            return {m_calls.load(std::memory_order_relaxed),
+                    std::chrono::nanoseconds(m_stub_ns.load(std::memory_order_relaxed)),
+                    std::chrono::nanoseconds(m_original_ns.load(std::memory_order_relaxed))};
+        }
+
+    private:
+        CCallStatistics(const CCallStatistics&) = delete;
+        CCallStatistics& operator=(const CCallStatistics&) = delete;
+    };
+
+    /********************************************************************
+        All the statistics of the process.
+    ********************************************************************/
+    class CCallStatisticsRegistry {
+    public:
+        // The totals of a function, summed over the test files declaring it
+        struct Entry {
+            std::string name;
+            std::string kind;
+            CCallStatistics::Totals totals;
+        };
+
+        typedef std::map<const CCallStatistics*, CCallStatistics::Totals> Snapshot;
+
+    private:
+        std::mutex m_mutex;
+        std::vector<const CCallStatistics*> m_statistics;
+
+    public:
+        static CCallStatisticsRegistry& Instance() {
+            static CCallStatisticsRegistry instance;
+            return instance;
+        }
+
+        void Add(const CCallStatistics* statistics) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_statistics.push_back(statistics);
+        }
+
+        Snapshot Take() {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            Snapshot snapshot;
+            for (const CCallStatistics* statistics : m_statistics) {
+                snapshot[statistics] = statistics->totals();
+            }
+            return snapshot;
+        }
+
+        /********************************************************************
+            @brief The functions called since a snapshot, busiest first.
+
+            @param since [IN] The snapshot. Functions missing from it
+                (first used later) are counted from zero.
+        ********************************************************************/
+        std::vector<Entry> Entries(const Snapshot& since = Snapshot()) {
+            std::map<std::pair<std::string, std::string>, CCallStatistics::Totals> merged;
+            for (const auto& current : Take()) {
+                CCallStatistics::Totals totals = current.second;
+                auto previous = since.find(current.first);
+                if (since.end() != previous) {
+                    totals.calls -= previous->second.calls;
+                    totals.stub -= previous->second.stub;
+                    totals.original -= previous->second.original;
+                }
+                if (0 == totals.calls) {
+                    continue;
+                }
+                CCallStatistics::Totals& sum = merged[{current.first->name(), current.first->kind()}];
+                sum.calls += totals.calls;
+                sum.stub += totals.stub;
+                sum.original += totals.original;
+            }
+
+            std::vector<Entry> entries;
+            for (const auto& function : merged) {
+                entries.push_back({function.first.first, function.first.second, function.second});
+            }
+            std::sort(entries.begin(), entries.end(), [](const Entry& first, const Entry& second) {
+                return first.totals.stub > second.totals.stub;
+            });
+            return entries;
+        }
+
+    private:
+        CCallStatisticsRegistry() = default;
+    };
+
+    inline CCallStatistics::CCallStatistics(const char* name, const char* kind)
+            : m_name(name), m_kind(kind), m_calls(0), m_stub_ns(0), m_original_ns(0) {
+        CCallStatisticsRegistry::Instance().Add(this);
+    }
+
+    /********************************************************************
+        Adds the time until destruction to the time spent in the
+        original function.
+    ********************************************************************/
+    class COriginalCallTimer {
+    private:
+        CCallStatistics& m_statistics;
+        std::chrono::steady_clock::time_point m_start;
+
+    public:
+        explicit COriginalCallTimer(CCallStatistics& statistics)
+                : m_statistics(statistics), m_start(std::chrono::steady_clock::now()) {}
+
+        ~COriginalCallTimer() {
+            m_statistics.AddOriginal(std::chrono::steady_clock::now() - m_start);
+        }
+    };
+
+    template<subhook_t* Hook, typename Signature>
+    class CScopedCountedHook;
+
+    /********************************************************************
+        A hook installed by INSTALL_HOOK while statistics are collected.
+        The function jumps to a generated stub, which times the call to
+        the actual stub. Has CScopedHookInstall's interface.
+
+        Hook - The function's handle, declared by DECLARE_HOOKABLE
+    ********************************************************************/
+    template<subhook_t* Hook, typename R, typename... Args>
+    class CScopedCountedHook<Hook, R(Args...)> {
+    private:
+        typedef R (* Stub)(Args...);
+
+        // The stub of the innermost hook installed, as nested hooks on the same function share the generated stub
+        static inline std::atomic<Stub> s_stub{nullptr};
+
+        Stub m_previous_stub;
+        CScopedHookInstall m_install;
+
+    public:
+        CScopedCountedHook(const char* name, void* src, void* stub)
+                : m_previous_stub(s_stub.exchange((Stub) stub)), m_install(Hook, src, nullptr) {
+            Statistics(name);
+            try {
+                m_install.Replace((void*) Call);
+            } catch (...) {
+                s_stub.store(m_previous_stub);
+                throw;
+            }
+        }
+
+        ~CScopedCountedHook() {
+            m_install.Remove();
+            s_stub.store(m_previous_stub);
+        }
+
+        void Replace(void* stub) {
+            s_stub.store((Stub) stub);
+            m_install.Replace((void*) Call);
+        }
+
+        void Remove() {
+            m_install.Remove();
+        }
+
+        // The statistics of the function. The name is used on the first call only.
+        static CCallStatistics& Statistics(const char* name) {
+            static CCallStatistics statistics(name, "hook");
+            return statistics;
+        }
+
+    private:
+        static R Call(Args... args) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            CCallTimer timer(start);
+            return s_stub.load()(args...);
+        }
+
+        // Adds the call when the stub returns, even if it returns a value
+        class CCallTimer {
+        private:
+            std::chrono::steady_clock::time_point m_start;
+
+        public:
+            explicit CCallTimer(std::chrono::steady_clock::time_point start) : m_start(start) {}
+
+            ~CCallTimer() {
+                Statistics(nullptr).AddCall(std::chrono::steady_clock::now() - m_start);
+            }
+        };
+
+        CScopedCountedHook(const CScopedCountedHook&) = delete;
+        CScopedCountedHook& operator=(const CScopedCountedHook&) = delete;
+    };
+
+    // Functions with ellipsis can't be forwarded by a generated stub, so their calls aren't counted
+    template<subhook_t* Hook, typename R, typename... Args>
+    class CScopedCountedHook<Hook, R(Args..., ...)> : public CScopedHookInstall {
+    public:
+        CScopedCountedHook(const char* name, void* src, void* stub) : CScopedHookInstall(Hook, src, stub) {
+            Statistics(name);
+        }
+
+        static CCallStatistics& Statistics(const char* name) {
+            static CCallStatistics statistics(name, "hook");
+            return statistics;
+        }
+    };
+
+}
+
+#endif //CUTIE_CALL_STATISTICS_HPP
@@ -0,0 +1,168 @@
+/********************************************************************
+	File name:	call_statistics_listener.hpp
+	Project  :	Cutie
+	Author   :	Dor Cohen
+
+    A GoogleTest listener reporting the call statistics of
+    call_statistics.hpp: it prints the busiest functions of each test,
+    and a sorted table of all of them when the tests end, and writes
+    the table as JSON.
+    Registered when CUTIE_CALL_STATISTICS is defined, by every test
+    executable including mock.hpp. Kept out of hook.hpp, so hooks don't
+    depend on GoogleTest.
+    The statistics are per process, so with the fork server, each child
+    reports the tests it ran. Each process writes a JSON report of its
+    own, named after its pid, so children and parallel shards of the
+    same executable never overwrite each other.
+
+********************************************************************/
+#ifndef CUTIE_CALL_STATISTICS_LISTENER_HPP
+#define CUTIE_CALL_STATISTICS_LISTENER_HPP
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include "call_statistics.hpp"
+
+namespace cutie {
+
+    /********************************************************************
+        Reports the statistics at the end of each test, and of the tests.
+        The JSON report is written to the path in the
+        CUTIE_CALL_STATISTICS_JSON environment variable, where %p is
+        replaced by the process id, or to
+        <executable>.<pid>.call_statistics.json in the working directory.
+    ********************************************************************/
+    class CCallStatisticsListener : public ::testing::EmptyTestEventListener {
+    private:
+        // The number of functions printed per test
+        static constexpr size_t g_busiest_per_test = 3;
+
+        struct TestEntries {
+            std::string name;
+            std::vector<CCallStatisticsRegistry::Entry> entries;
+        };
+
+        CCallStatisticsRegistry::Snapshot m_test_start;
+        std::vector<TestEntries> m_tests;
+
+    public:
+        // Appends a listener to GoogleTest's listeners, which owns it
+        static bool Register() {
+            ::testing::UnitTest::GetInstance()->listeners().Append(new CCallStatisticsListener());
+            return true;
+        }
+
+        void OnTestStart(const ::testing::TestInfo&) override {
+            m_test_start = CCallStatisticsRegistry::Instance().Take();
+        }
+
+        void OnTestEnd(const ::testing::TestInfo& test_info) override {
+            std::vector<CCallStatisticsRegistry::Entry> entries =
+                    CCallStatisticsRegistry::Instance().Entries(m_test_start);
+            if (entries.empty()) {
+                return;
+            }
+            for (size_t i = 0; i < entries.size() && i < g_busiest_per_test; ++i) {
+                const CCallStatisticsRegistry::Entry& entry = entries[i];
+                std::printf("[  CALLS   ] %s (%s): %llu calls, %s\n", entry.name.c_str(), entry.kind.c_str(),
+                            (unsigned long long) entry.totals.calls, FormatTimes(entry.totals).c_str());
+            }
+            std::fflush(stdout);
+            m_tests.push_back({std::string(test_info.test_suite_name()) + "." + test_info.name(), entries});
+        }
+
+        void OnTestProgramEnd(const ::testing::UnitTest&) override {
+            std::vector<CCallStatisticsRegistry::Entry> entries = CCallStatisticsRegistry::Instance().Entries();
+            if (entries.empty()) {
+                return;
+            }
+            std::printf("[  CALLS   ] Mocked and hooked calls, by time spent in their stubs:\n");
+            std::printf("[  CALLS   ] %12s %14s %14s  %s\n", "calls", "total (ms)", "original (ms)", "function");
+            for (const CCallStatisticsRegistry::Entry& entry : entries) {
+                std::printf("[  CALLS   ] %12llu %14.3f %14.3f  %s (%s)\n", (unsigned long long) entry.totals.calls,
+                            Milliseconds(entry.totals.stub), Milliseconds(entry.totals.original), entry.name.c_str(),
+                            entry.kind.c_str());
+            }
+
+            std::string path = JsonPath();
+            FILE* file = std::fopen(path.c_str(), "w");
+            if (nullptr == file) {
+                std::printf("[  CALLS   ] Can't write %s\n", path.c_str());
+            } else {
+                std::string json = ToJson(entries);
+                std::fwrite(json.data(), 1, json.size(), file);
+                std::fclose(file);
+                std::printf("[  CALLS   ] Written to %s\n", path.c_str());
+            }
+            std::fflush(stdout);
+        }
+
+    private:
+        static double Milliseconds(std::chrono::nanoseconds duration) {
+            return std::chrono::duration<double, std::milli>(duration).count();
+        }
+
+        static std::string FormatTimes(const CCallStatistics::Totals& totals) {
+            std::ostringstream text;
+            text << std::fixed << std::setprecision(3) << Milliseconds(totals.stub) << "ms total";
+            if (totals.original.count() > 0) {
+                text << ", " << Milliseconds(totals.original) << "ms in the original";
+            }
+            return text.str();
+        }
+
+        static std::string JsonPath() {
+            std::string pid = std::to_string(getpid());
+            const char* path = std::getenv("CUTIE_CALL_STATISTICS_JSON");
+            if (nullptr == path || '\0' == path[0]) {
+                return std::string(program_invocation_short_name) + "." + pid + ".call_statistics.json";
+            }
+            std::string expanded = path;
+            for (size_t position = expanded.find("%p"); std::string::npos != position;
+                 position = expanded.find("%p", position + pid.size())) {
+                expanded.replace(position, 2, pid);
+            }
+            return expanded;
+        }
+
+        static void AppendJson(std::ostringstream& json, const std::vector<CCallStatisticsRegistry::Entry>& entries) {
+            json << "[";
+            for (size_t i = 0; i < entries.size(); ++i) {
+                const CCallStatisticsRegistry::Entry& entry = entries[i];
+                json << (0 == i ? "" : ",") << "\n    {\"name\": \"" << entry.name << "\", \"kind\": \"" << entry.kind
+                     << "\", \"calls\": " << entry.totals.calls << ", \"total_ns\": " << entry.totals.stub.count()
+                     << ", \"original_ns\": " << entry.totals.original.count() << "}";
+            }
+            json << "]";
+        }
+
+        std::string ToJson(const std::vector<CCallStatisticsRegistry::Entry>& entries) const {
+            std::ostringstream json;
+            json << "{\n  \"functions\": ";
+            AppendJson(json, entries);
+            json << ",\n  \"tests\": [";
+            for (size_t i = 0; i < m_tests.size(); ++i) {
+                json << (0 == i ? "" : ",") << "\n  {\"name\": \"" << m_tests[i].name << "\", \"functions\": ";
+                AppendJson(json, m_tests[i].entries);
+                json << "}";
+            }
+            json << "]\n}\n";
+            return json.str();
+        }
+    };
+
+#ifdef CUTIE_CALL_STATISTICS
+    inline const bool g_call_statistics_listener = CCallStatisticsListener::Register();
+#endif
+
+}
+
+#endif //CUTIE_CALL_STATISTICS_LISTENER_HPP
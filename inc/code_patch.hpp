@@ -0,0 +1,102 @@
+/********************************************************************
+	File name:	code_patch.hpp
+	Project  :	Cutie
+	Author   :	Dor Cohen
+
+    Low-level helpers for writing a jump over a function's prologue.
+    Subhook is still used for building trampolines, but redirecting
+    an already-created hook is done here, by rewriting the jump's
+    destination in place.
+    On AArch64, which Subhook doesn't support, the trampolines are
+    built by subhook_arm64.hpp instead.
+
+********************************************************************/
+#ifndef CUTIE_CODE_PATCH_HPP
+#define CUTIE_CODE_PATCH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined __aarch64__
+#include "subhook_arm64.hpp"
+#else
+#include <subhook.h>
+#endif
+
+namespace cutie {
+
+#if defined SUBHOOK_X86_64
+    static subhook_flags_t g_subhook_flags = SUBHOOK_64BIT_OFFSET;
+    // jmp qword ptr [rip+0] followed by the absolute destination.
+    // Same size as Subhook's 64-bit jump, so Subhook's trampolines cover it.
+    static constexpr size_t g_jump_size = 14;
+#elif defined SUBHOOK_X86
+    static subhook_flags_t g_subhook_flags = 0;
+    // jmp rel32
+    static constexpr size_t g_jump_size = 5;
+#elif defined SUBHOOK_ARM64
+    static subhook_flags_t g_subhook_flags = (subhook_flags_t) 0;
+    // ldr x16, #8; br x16; followed by the absolute destination
+    static constexpr size_t g_jump_size = 16;
+#else
+#error Unsupported bitness
+#endif
+
+    /********************************************************************
+        @brief Encode a jump from src to dst into code.
+
+        @param code [OUT] A buffer of at least g_jump_size bytes
+        @param src [IN] The address the jump will be written to
+        @param dst [IN] The address to jump to
+    ********************************************************************/
+    inline void EncodeJump(unsigned char* code, const void* src, const void* dst) {
+#if defined SUBHOOK_X86_64
+        static const unsigned char jmp_rip[] = {0xFF, 0x25, 0x00, 0x00, 0x00, 0x00};
+        uint64_t destination = (uint64_t) (uintptr_t) dst;
+        std::memcpy(code, jmp_rip, sizeof(jmp_rip));
+        std::memcpy(code + sizeof(jmp_rip), &destination, sizeof(destination));
+#elif defined SUBHOOK_ARM64
+        static const uint32_t ldr_br[] = {0x58000050, 0xD61F0200};
+        uint64_t destination = (uint64_t) (uintptr_t) dst;
+        (void) src;
+        std::memcpy(code, ldr_br, sizeof(ldr_br));
+        std::memcpy(code + sizeof(ldr_br), &destination, sizeof(destination));
+#else
+        int32_t offset = (int32_t) ((intptr_t) dst - ((intptr_t) src + (intptr_t) g_jump_size));
+        code[0] = 0xE9;
+        std::memcpy(code + 1, &offset, sizeof(offset));
+#endif
+    }
+
+    /********************************************************************
+        @brief Get the page range containing [address, address + size)
+    ********************************************************************/
+    inline void GetPageRange(const void* address, size_t size, uintptr_t* start, size_t* length) {
+        uintptr_t page_size = (uintptr_t) sysconf(_SC_PAGESIZE);
+        uintptr_t begin = (uintptr_t) address & ~(page_size - 1);
+        uintptr_t end = ((uintptr_t) address + size + page_size - 1) & ~(page_size - 1);
+        *start = begin;
+        *length = (size_t) (end - begin);
+    }
+
+    /********************************************************************
+        @brief Set the protection of the pages containing [address, address + size)
+
+        @return true on success
+    ********************************************************************/
+    inline bool SetCodeProtection(const void* address, size_t size, int protection) {
+        uintptr_t start = 0;
+        size_t length = 0;
+        GetPageRange(address, size, &start, &length);
+        return 0 == mprotect((void*) start, length, protection);
+    }
+
+    inline void FlushInstructionCache(void* address, size_t size) {
+        __builtin___clear_cache((char*) address, (char*) address + size);
+    }
+
+}
+
+#endif //CUTIE_CODE_PATCH_HPP
@@ -0,0 +1,223 @@
+/********************************************************************
+	File name:	code_patcher.hpp
+	Project  :	Cutie
+	Author   :	Dor Cohen
+
+    Serializes all code patching done by Cutie, and makes it safe to
+    patch functions while other threads may be running them.
+
+    Patch Modes
+    ~~~~~~~~~~~
+    Plain        - The code is simply overwritten. Fastest, but a thread that
+                   runs the function while it's being patched may crash.
+                   This is the default.
+    Atomic       - The patch is written with a single atomic
+                   compare-and-exchange (16 bytes on x86-64, 8 bytes elsewhere),
+                   so other threads see either the old code or the new one.
+                   Possible only if the patch doesn't cross an aligned block,
+                   which is usually the case as compilers align functions.
+                   Otherwise, falls back to StopTheWorld.
+                   A thread that already ran the first instructions of the
+                   prologue may still see the new code mid-way.
+    StopTheWorld - All other threads are suspended while the code is written,
+                   and the patch is retried until no thread is interrupted
+                   in the middle of the patched instructions.
+                   If the threads can't be stopped (a thread doesn't park
+                   in time, for example as it blocks the signal), nothing
+                   is written and the patch fails.
+
+********************************************************************/
+#ifndef CUTIE_CODE_PATCHER_HPP
+#define CUTIE_CODE_PATCHER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+#include "code_patch.hpp"
+#include "stop_the_world.hpp"
+
+namespace cutie {
+
+    enum class PatchMode {
+        Plain,
+        Atomic,
+        StopTheWorld
+    };
+
+    struct CodePatch {
+        void* address;
+        const void* code;
+        size_t size;
+    };
+
+    class CCodePatcher {
+    private:
+        std::recursive_mutex m_mutex;
+        std::atomic<PatchMode> m_mode;
+
+    public:
+        // Never destroyed, so hooks can be removed during static destruction
+        static CCodePatcher& Instance() {
+            static CCodePatcher* instance = new CCodePatcher();
+            return *instance;
+        }
+
+        void set_mode(PatchMode mode) { m_mode.store(mode); }
+
+        PatchMode mode() const { return m_mode.load(); }
+
+        // Held while patching. Lock it to make several patches appear as one to other patchers.
+        std::recursive_mutex& mutex() { return m_mutex; }
+
+        /********************************************************************
+            @brief Overwrite code according to the current patch mode.
+
+            @return true on success
+        ********************************************************************/
+        bool Write(void* address, const void* code, size_t size) {
+            CodePatch patch = {address, code, size};
+            return Write(&patch, 1);
+        }
+
+        /********************************************************************
+            @brief Overwrite several pieces of code as a single batch.
+                The protection of each page is changed once, the world is
+                stopped at most once, and the instruction cache is flushed
+                once. Patches are applied in order, so a later patch to the
+                same address wins.
+
+            @return true on success. false if the code can't be made
+                writable, or if other threads can't be stopped (see
+                CStopTheWorld), in which case nothing is written.
+        ********************************************************************/
+        bool Write(const CodePatch* patches, size_t count) {
+            std::lock_guard<std::recursive_mutex> lock(m_mutex);
+            std::vector<uintptr_t> pages = GetPages(patches, count);
+            for (uintptr_t page : pages) {
+                if (!SetCodeProtection((void*) page, 1, PROT_READ | PROT_WRITE | PROT_EXEC)) {
+                    RestoreProtection(pages);
+                    return false;
+                }
+            }
+
+            // The mode is read once, so a batch is never written in two modes
+            PatchMode mode = this->mode();
+            std::vector<bool> atomic(count, false);
+            std::vector<CodeRange> ranges;
+            for (size_t i = 0; i < count; ++i) {
+                atomic[i] = (PatchMode::Atomic == mode) && CanWriteAtomic(patches[i]);
+                if (!atomic[i]) {
+                    ranges.push_back(CodeRange((uintptr_t) patches[i].address, patches[i].size));
+                }
+            }
+            // Nothing is written unless the world is stopped, as writing anyway is exactly what the mode prevents
+            std::unique_ptr<CStopTheWorld> stop;
+            if (!ranges.empty() && (PatchMode::Plain != mode)) {
+                stop.reset(new CStopTheWorld(ranges));
+                if (!stop->stopped()) {
+                    RestoreProtection(pages);
+                    return false;
+                }
+            }
+            for (size_t i = 0; i < count; ++i) {
+                if (atomic[i]) {
+                    WriteAtomic(patches[i]);
+                } else {
+                    std::memcpy(patches[i].address, patches[i].code, patches[i].size);
+                }
+            }
+            stop.reset();
+
+            RestoreProtection(pages);
+            FlushInstructionCache(patches, count);
+            return true;
+        }
+
+    private:
+        CCodePatcher() : m_mode(PatchMode::Plain) {}
+
+        static std::vector<uintptr_t> GetPages(const CodePatch* patches, size_t count) {
+            std::set<uintptr_t> pages;
+            uintptr_t page_size = (uintptr_t) sysconf(_SC_PAGESIZE);
+            for (size_t i = 0; i < count; ++i) {
+                uintptr_t start = 0;
+                size_t length = 0;
+                GetPageRange(patches[i].address, patches[i].size, &start, &length);
+                for (uintptr_t page = start; page < start + length; page += page_size) {
+                    pages.insert(page);
+                }
+            }
+            return std::vector<uintptr_t>(pages.begin(), pages.end());
+        }
+
+        static void RestoreProtection(const std::vector<uintptr_t>& pages) {
+            for (uintptr_t page : pages) {
+                SetCodeProtection((void*) page, 1, PROT_READ | PROT_EXEC);
+            }
+        }
+
+        // A single flush covering all patches
+        static void FlushInstructionCache(const CodePatch* patches, size_t count) {
+            if (0 == count) {
+                return;
+            }
+            uintptr_t begin = (uintptr_t) patches[0].address;
+            uintptr_t end = begin + patches[0].size;
+            for (size_t i = 1; i < count; ++i) {
+                begin = std::min(begin, (uintptr_t) patches[i].address);
+                end = std::max(end, (uintptr_t) patches[i].address + patches[i].size);
+            }
+            cutie::FlushInstructionCache((void*) begin, (size_t) (end - begin));
+        }
+
+#if defined SUBHOOK_X86_64
+        static constexpr size_t g_atomic_block = 16;
+
+        static bool CompareExchangeBlock(void* block, uint64_t* expected, const uint64_t* desired) {
+            bool exchanged = false;
+            __asm__ __volatile__("lock cmpxchg16b %1\n\tsete %0"
+            : "=q"(exchanged), "+m"(*(volatile uint64_t (*)[2]) block), "+a"(expected[0]), "+d"(expected[1])
+            : "b"(desired[0]), "c"(desired[1])
+            : "memory", "cc");
+            return exchanged;
+        }
+#else
+        static constexpr size_t g_atomic_block = 8;
+
+        static bool CompareExchangeBlock(void* block, uint64_t* expected, const uint64_t* desired) {
+            return __atomic_compare_exchange_n((uint64_t*) block, expected, desired[0], false,
+                                               __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+        }
+#endif
+
+        // Whether the patch doesn't cross an aligned block, so it can be written with a single compare-and-exchange
+        static bool CanWriteAtomic(const CodePatch& patch) {
+            uintptr_t block = (uintptr_t) patch.address & ~(uintptr_t) (g_atomic_block - 1);
+            return ((uintptr_t) patch.address - block) + patch.size <= g_atomic_block;
+        }
+
+        // The patch must pass CanWriteAtomic(), and the code must already be writable
+        static void WriteAtomic(const CodePatch& patch) {
+            uintptr_t block = (uintptr_t) patch.address & ~(uintptr_t) (g_atomic_block - 1);
+            size_t offset = (uintptr_t) patch.address - block;
+            uint64_t expected[2] = {};
+            uint64_t desired[2] = {};
+            do {
+                std::memcpy(expected, (void*) block, g_atomic_block);
+                std::memcpy(desired, expected, g_atomic_block);
+                std::memcpy((unsigned char*) desired + offset, patch.code, patch.size);
+            } while (!CompareExchangeBlock((void*) block, expected, desired));
+        }
+
+        CCodePatcher(const CCodePatcher&) = delete;
+        CCodePatcher& operator=(const CCodePatcher&) = delete;
+    };
+
+}
+
+#endif //CUTIE_CODE_PATCHER_HPP
@@ -0,0 +1,75 @@
+/********************************************************************
+	File name:	fast_default.hpp
+	Project  :	Cutie
+	Author   :	Dor Cohen
+
+    A fast path for mocks that only have a default behavior.
+    A mock whose only behavior is a single ON_CALL() matching any
+    arguments (such as "always return -1") doesn't need GMock to choose
+    an action, so its stub performs the action directly, as a plain
+    hook would, without GMock's locking and matching.
+    The mock goes back to GMock once an expectation, or a default with
+    matchers or a With() clause, is set on it. A default set after an
+    expectation stays with GMock too, so the expectation is matched.
+    Only used internally by CUTIE_ON_CALL.
+
+********************************************************************/
+#ifndef CUTIE_FAST_DEFAULT_HPP
+#define CUTIE_FAST_DEFAULT_HPP
+
+#include <type_traits>
+#include <gmock/gmock.h>
+#include "function_traits.hpp"
+
+namespace cutie {
+
+    // Whether all the matchers of an ON_CALL() are the "_" wildcard, so it matches any arguments
+    template<typename... Matchers>
+    constexpr bool AreWildcards(const Matchers&...) {
+        return (std::is_same_v<Matchers, ::testing::internal::AnythingMatcher> && ...);
+    }
+
+    /********************************************************************
+        Wraps GMock's ON_CALL() spec, and gives its action to the
+        container as well, if it's performed for any arguments.
+    ********************************************************************/
+    template<typename Container, typename F>
+    class CDefaultSpec {
+    private:
+        Container& m_container;
+        ::testing::internal::OnCallSpec<F>& m_spec;
+        bool m_unconditional;
+
+    public:
+        CDefaultSpec(Container& container, ::testing::internal::OnCallSpec<F>& spec, bool unconditional)
+                : m_container(container), m_spec(spec), m_unconditional(unconditional) {
+            // Defaults set later take precedence, so a conditional one must be chosen by GMock
+            m_container.clear_fast_default();
+        }
+
+        template<typename Matcher>
+        CDefaultSpec& With(const Matcher& matcher) {
+            m_unconditional = false;
+            m_spec.With(matcher);
+            return *this;
+        }
+
+        template<typename Action>
+        CDefaultSpec& WillByDefault(const Action& action) {
+            m_spec.WillByDefault(action);
+            if (m_unconditional) {
+                m_container.set_fast_default(::testing::Action<Signature<F> >(action));
+            }
+            return *this;
+        }
+    };
+
+    template<typename Container, typename F>
+    CDefaultSpec<Container, F> MakeDefaultSpec(Container& container, ::testing::internal::OnCallSpec<F>& spec,
+                                               bool unconditional) {
+        return CDefaultSpec<Container, F>(container, spec, unconditional);
+    }
+
+}
+
+#endif //CUTIE_FAST_DEFAULT_HPP
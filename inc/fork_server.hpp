@@ -0,0 +1,269 @@
+/********************************************************************
+	File name:	fork_server.hpp
+	Project  :	Cutie
+	Author   :	Dor Cohen
+
+    A test runner that forks instead of starting a process per test.
+    The executable is loaded, and its static objects are initialized,
+    once. Then each test case (or each test suite) runs in a child
+    forked from that snapshot, so hooks, mocks and other global state
+    left behind by one test never reach the next.
+    Only used internally by fork_server_main.cpp, which is linked into
+    the tests instead of GoogleMock's main() when the CUTIE_FORK_SERVER
+    option is set.
+
+    Linux only, as children are killed with their server through prctl().
+
+********************************************************************/
+#ifndef CUTIE_FORK_SERVER_HPP
+#define CUTIE_FORK_SERVER_HPP
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <gtest/gtest.h>
+
+// Resets the coverage counters of the child, so the code run before the fork is counted once, by the server
+extern "C" void __gcov_reset(void) __attribute__((weak));
+
+namespace cutie {
+
+    class CForkServer {
+    public:
+        enum class Isolation {
+            // Run the tests in the server itself, as GoogleTest's main() does
+            None,
+            // Fork a child per test case
+            Test,
+            // Fork a child per test suite, so SetUpTestSuite() runs once per suite
+            Suite,
+        };
+
+    private:
+        struct Child {
+            std::string name;
+            std::string filter;
+        };
+
+        // The tests GoogleTest skips unless --gtest_also_run_disabled_tests is given
+        static constexpr const char* g_disabled_filter = "DISABLED_*:*/DISABLED_*";
+
+        Isolation m_isolation;
+
+    public:
+        /********************************************************************
+            @brief Must be constructed before GoogleTest parses the
+                command line, which removes its flags from it.
+
+            @param isolation [IN] The tests each child runs. Overridden by
+                the CUTIE_FORK_SERVER environment variable ("test", "suite"
+                or "off"), for example to debug a test in a single process.
+            @param argc [IN] The number of command line arguments
+            @param argv [IN] The command line arguments
+        ********************************************************************/
+        CForkServer(Isolation isolation, int argc, char** argv) : m_isolation(isolation) {
+            const char* value = std::getenv("CUTIE_FORK_SERVER");
+            if (nullptr != value) {
+                if (0 == std::strcmp(value, "test")) {
+                    m_isolation = Isolation::Test;
+                } else if (0 == std::strcmp(value, "suite")) {
+                    m_isolation = Isolation::Suite;
+                } else if (0 == std::strcmp(value, "off")) {
+                    m_isolation = Isolation::None;
+                }
+            }
+            for (int i = 1; i < argc; ++i) {
+                // A death test re-executing the test (the "threadsafe" style) runs the single test it asks for
+                if (0 == std::strncmp(argv[i], "--gtest_internal_run_death_test", 31)) {
+                    m_isolation = Isolation::None;
+                }
+            }
+        }
+
+        /********************************************************************
+            @brief Run the selected tests, as RUN_ALL_TESTS() does.
+                Must be called after GoogleTest parses the command line.
+
+            @return 0 if all tests passed, 1 otherwise
+        ********************************************************************/
+        int Run() {
+            if (Isolation::None == m_isolation || ::testing::GTEST_FLAG(list_tests)) {
+                return RUN_ALL_TESTS();
+            }
+            // The children would overwrite each other's report, so a single process runs the tests and writes it
+            if (!::testing::GTEST_FLAG(output).empty()) {
+                std::cout << "[  FORKED  ] --gtest_output is set, so the tests run in a single process, "
+                             "without isolation" << std::endl;
+                return RUN_ALL_TESTS();
+            }
+            std::vector<Child> children = SelectChildren();
+            if (children.empty()) {
+                return RUN_ALL_TESTS();
+            }
+            // The children select their tests by name, as sharding was already applied to the selection
+            unsetenv("GTEST_TOTAL_SHARDS");
+            unsetenv("GTEST_SHARD_INDEX");
+
+            std::vector<std::string> failures;
+            for (const Child& child : children) {
+                std::string failure = RunChild(child);
+                if (!failure.empty()) {
+                    failures.push_back(failure);
+                }
+            }
+
+            std::cout << "[  FORKED  ] " << children.size() << " children, " << failures.size() << " failed"
+                      << std::endl;
+            for (const std::string& failure : failures) {
+                std::cout << "[  FAILED  ] " << failure << std::endl;
+            }
+            return failures.empty() ? 0 : 1;
+        }
+
+    private:
+        /********************************************************************
+            @brief List the tests selected by the command line (its filter,
+                --gtest_also_run_disabled_tests and the shard of
+                GTEST_SHARD_INDEX), grouped into the children that run them.
+                GoogleTest only selects the tests within RUN_ALL_TESTS(), so
+                TestInfo::should_run() isn't set yet, and the selection is
+                made here the same way, without running anything.
+
+            @return The children, or nothing if the server should run the
+                tests itself, as when the shard variables are invalid, for
+                GoogleTest to report
+        ********************************************************************/
+        std::vector<Child> SelectChildren() const {
+            std::vector<Child> children;
+            int total_shards = 1;
+            int shard_index = 0;
+            const char* total_value = std::getenv("GTEST_TOTAL_SHARDS");
+            const char* index_value = std::getenv("GTEST_SHARD_INDEX");
+            if (nullptr != total_value || nullptr != index_value) {
+                total_shards = (nullptr == total_value) ? -1 : std::atoi(total_value);
+                shard_index = (nullptr == index_value) ? -1 : std::atoi(index_value);
+                if (total_shards < 1 || shard_index < 0 || shard_index >= total_shards) {
+                    return children;
+                }
+            }
+
+            std::string filter = ::testing::GTEST_FLAG(filter);
+            size_t dash = filter.find('-');
+            std::string positive = filter.substr(0, dash);
+            std::string negative = (std::string::npos == dash) ? "" : filter.substr(dash + 1);
+            if (positive.empty()) {
+                positive = "*";
+            }
+
+            // Runnable tests are counted across all shards, and dealt to them in turn
+            int runnable = 0;
+            const ::testing::UnitTest& unit_test = *::testing::UnitTest::GetInstance();
+            for (int i = 0; i < unit_test.total_test_case_count(); ++i) {
+                const ::testing::TestCase& test_case = *unit_test.GetTestCase(i);
+                Child suite{test_case.name(), ""};
+                bool suite_disabled = MatchesFilter(g_disabled_filter, test_case.name());
+                for (int j = 0; j < test_case.total_test_count(); ++j) {
+                    const ::testing::TestInfo& test_info = *test_case.GetTestInfo(j);
+                    std::string name = std::string(test_case.name()) + "." + test_info.name();
+                    bool disabled = suite_disabled || MatchesFilter(g_disabled_filter, test_info.name());
+                    if ((disabled && !::testing::GTEST_FLAG(also_run_disabled_tests)) ||
+                        !MatchesFilter(positive, name) || MatchesFilter(negative, name)) {
+                        continue;
+                    }
+                    if (shard_index != runnable++ % total_shards) {
+                        continue;
+                    }
+                    if (Isolation::Test == m_isolation) {
+                        children.push_back({name, name});
+                    } else {
+                        suite.filter += (suite.filter.empty() ? "" : ":") + name;
+                    }
+                }
+                if (!suite.filter.empty()) {
+                    children.push_back(suite);
+                }
+            }
+            return children;
+        }
+
+        // Whether name matches one of the ':' separated patterns of a GoogleTest filter
+        static bool MatchesFilter(const std::string& filter, const std::string& name) {
+            size_t begin = 0;
+            while (begin <= filter.size()) {
+                size_t end = filter.find(':', begin);
+                if (std::string::npos == end) {
+                    end = filter.size();
+                }
+                if (MatchesPattern(filter.substr(begin, end - begin).c_str(), name.c_str())) {
+                    return true;
+                }
+                begin = end + 1;
+            }
+            return false;
+        }
+
+        // Whether name matches a pattern, where '*' matches any string and '?' any single character
+        static bool MatchesPattern(const char* pattern, const char* name) {
+            if ('*' == *pattern) {
+                return MatchesPattern(pattern + 1, name) || (('\0' != *name) && MatchesPattern(pattern, name + 1));
+            }
+            if ('\0' == *pattern) {
+                return '\0' == *name;
+            }
+            return ('\0' != *name) && (('?' == *pattern) || (*pattern == *name)) &&
+                   MatchesPattern(pattern + 1, name + 1);
+        }
+
+        /********************************************************************
+            @brief Run the tests of a single child, and wait for it.
+
+            @return A description of the failure, or an empty string if
+                all its tests passed
+        ********************************************************************/
+        static std::string RunChild(const Child& child) {
+            // Output buffered before the fork would be written twice
+            std::cout.flush();
+            std::fflush(nullptr);
+            pid_t pid = fork();
+            if (-1 == pid) {
+                return child.name + " (fork() failed: " + std::strerror(errno) + ")";
+            }
+            if (0 == pid) {
+                // Don't outlive the server, if CTest kills it on a timeout
+                prctl(PR_SET_PDEATHSIG, SIGKILL);
+                if (nullptr != __gcov_reset) {
+                    __gcov_reset();
+                }
+                ::testing::GTEST_FLAG(filter) = child.filter;
+                // exit() rather than _exit(), so the child writes its coverage data
+                std::exit(RUN_ALL_TESTS());
+            }
+
+            int status = 0;
+            while (-1 == waitpid(pid, &status, 0)) {
+                if (EINTR != errno) {
+                    return child.name + " (waitpid() failed: " + std::strerror(errno) + ")";
+                }
+            }
+            if (WIFSIGNALED(status)) {
+                return child.name + " (killed by signal " + std::to_string(WTERMSIG(status)) + ": " +
+                       strsignal(WTERMSIG(status)) + ")";
+            }
+            if (WIFEXITED(status) && 0 != WEXITSTATUS(status)) {
+                return child.name;
+            }
+            return "";
+        }
+    };
+
+}
+
+#endif //CUTIE_FORK_SERVER_HPP
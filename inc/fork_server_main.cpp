@@ -0,0 +1,23 @@
+/********************************************************************
+	File name:	fork_server_main.cpp
+	Project  :	Cutie
+	Author   :	Dor Cohen
+
+    The main() function of the tests when the CUTIE_FORK_SERVER option
+    is set, instead of GoogleMock's. Runs the tests through CForkServer.
+    CUTIE_FORK_PER_SUITE forks a child per test suite, instead of per
+    test case.
+
+********************************************************************/
+#include <gmock/gmock.h>
+#include "fork_server.hpp"
+
+int main(int argc, char** argv) {
+#ifdef CUTIE_FORK_PER_SUITE
+    cutie::CForkServer server(cutie::CForkServer::Isolation::Suite, argc, argv);
+#else
+    cutie::CForkServer server(cutie::CForkServer::Isolation::Test, argc, argv);
+#endif
+    testing::InitGoogleMock(&argc, argv);
+    return server.Run();
+}
@@ -0,0 +1,55 @@
+/********************************************************************
+	File name:	function_traits.hpp
+	Project  :	Cutie
+	Author   :	Dor Cohen
+
+    Compile-time information about C function types, as returned by
+    decltype(func). Used for generating typed stubs from a function's name.
+
+********************************************************************/
+#ifndef CUTIE_FUNCTION_TRAITS_HPP
+#define CUTIE_FUNCTION_TRAITS_HPP
+
+#include <cstddef>
+#include <tuple>
+
+namespace cutie {
+
+    template<typename Function>
+    struct FunctionTraits;
+
+    template<typename R, typename... Args>
+    struct FunctionTraits<R(Args...)> {
+        typedef R Result;
+        typedef R Signature(Args...);
+        typedef R (* Pointer)(Args...);
+        typedef std::tuple<Args...> Arguments;
+        static constexpr size_t arity = sizeof...(Args);
+    };
+
+    // C functions declared by glibc are noexcept when compiled as C++
+    template<typename R, typename... Args>
+    struct FunctionTraits<R(Args...) noexcept> : public FunctionTraits<R(Args...)> {
+    };
+
+    // C functions with ellipsis. The arguments and arity are of the fixed parameters.
+    template<typename R, typename... Args>
+    struct FunctionTraits<R(Args..., ...)> {
+        typedef R Result;
+        typedef R Signature(Args..., ...);
+        typedef R (* Pointer)(Args..., ...);
+        typedef std::tuple<Args...> Arguments;
+        static constexpr size_t arity = sizeof...(Args);
+    };
+
+    template<typename R, typename... Args>
+    struct FunctionTraits<R(Args..., ...) noexcept> : public FunctionTraits<R(Args..., ...)> {
+    };
+
+    // The function's signature, without noexcept
+    template<typename Function>
+    using Signature = typename FunctionTraits<Function>::Signature;
+
+}
+
+#endif //CUTIE_FUNCTION_TRAITS_HPP
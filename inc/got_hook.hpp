@@ -0,0 +1,260 @@
+/********************************************************************
+	File name:	got_hook.hpp
+	Project  :	Cutie
+	Author   :	Dor Cohen
+
+    Hooks that redirect the calls made through the dynamic linker,
+    instead of patching the function's code.
+    A call from one loaded object (the executable or a shared library)
+    to a function of another goes through a slot in the caller's Global
+    Offset Table (GOT), which the dynamic linker fills with the
+    function's address. Hooking the function for these callers is a
+    pointer store per slot: no trampoline, no executable page that is
+    made writable, and no instruction cache to flush. This works on
+    hosts that don't allow writable code (W^X), and on any architecture.
+    Slots in a RELRO segment are made writable while they're stored to.
+    Calls that don't go through the dynamic linker are not redirected:
+    calls within the object that defines the function (as from the
+    module under test to its own functions), calls through pointers
+    taken before the hook was installed, and calls from objects loaded
+    after it.
+
+********************************************************************/
+#ifndef CUTIE_GOT_HOOK_HPP
+#define CUTIE_GOT_HOOK_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <dlfcn.h>
+#include <elf.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace cutie {
+
+#if defined __x86_64__
+    typedef ElfW(Rela) GotRelocation;
+    static constexpr ElfW(Sxword) g_got_relocations_tag = DT_RELA;
+    static constexpr ElfW(Sxword) g_got_relocations_size_tag = DT_RELASZ;
+    static constexpr unsigned g_got_jump_slot = R_X86_64_JUMP_SLOT;
+    static constexpr unsigned g_got_data = R_X86_64_GLOB_DAT;
+#elif defined __i386__
+    typedef ElfW(Rel) GotRelocation;
+    static constexpr ElfW(Sxword) g_got_relocations_tag = DT_REL;
+    static constexpr ElfW(Sxword) g_got_relocations_size_tag = DT_RELSZ;
+    static constexpr unsigned g_got_jump_slot = R_386_JMP_SLOT;
+    static constexpr unsigned g_got_data = R_386_GLOB_DAT;
+#elif defined __aarch64__
+    typedef ElfW(Rela) GotRelocation;
+    static constexpr ElfW(Sxword) g_got_relocations_tag = DT_RELA;
+    static constexpr ElfW(Sxword) g_got_relocations_size_tag = DT_RELASZ;
+    static constexpr unsigned g_got_jump_slot = R_AARCH64_JUMP_SLOT;
+    static constexpr unsigned g_got_data = R_AARCH64_GLOB_DAT;
+#else
+#error Unsupported architecture
+#endif
+
+#if __ELF_NATIVE_CLASS == 64
+    inline unsigned RelocationType(ElfW(Xword) info) { return (unsigned) ELF64_R_TYPE(info); }
+
+    inline size_t RelocationSymbol(ElfW(Xword) info) { return (size_t) ELF64_R_SYM(info); }
+#else
+    inline unsigned RelocationType(ElfW(Word) info) { return (unsigned) ELF32_R_TYPE(info); }
+
+    inline size_t RelocationSymbol(ElfW(Word) info) { return (size_t) ELF32_R_SYM(info); }
+#endif
+
+    /********************************************************************
+        The GOT slots of all loaded objects.
+    ********************************************************************/
+    class CGotTable {
+    private:
+        struct Search {
+            const char* name;
+            std::vector<void**>* slots;
+            std::vector<std::pair<uintptr_t, uintptr_t> >* read_only;
+        };
+
+    public:
+        /********************************************************************
+            @brief Find the slots through which the loaded objects call or
+                refer to a function.
+
+            @param name [IN] The function's symbol name
+            @param read_only [OUT] The address ranges of the RELRO segments
+                containing any of the slots
+            @return The address of each slot
+        ********************************************************************/
+        static std::vector<void**> Find(const char* name, std::vector<std::pair<uintptr_t, uintptr_t> >* read_only) {
+            std::vector<void**> slots;
+            Search search = {name, &slots, read_only};
+            dl_iterate_phdr(&SearchObject, &search);
+            return slots;
+        }
+
+        /********************************************************************
+            @brief Store a value into a slot, making it writable meanwhile
+                if it's in one of the read_only ranges.
+        ********************************************************************/
+        static void Write(void** slot, void* value, const std::vector<std::pair<uintptr_t, uintptr_t> >& read_only) {
+            bool is_read_only = false;
+            for (const std::pair<uintptr_t, uintptr_t>& range : read_only) {
+                is_read_only = is_read_only || (((uintptr_t) slot >= range.first) && ((uintptr_t) slot < range.second));
+            }
+            void* page = (void*) ((uintptr_t) slot & ~((uintptr_t) sysconf(_SC_PAGESIZE) - 1));
+            if (is_read_only && (0 != mprotect(page, (size_t) sysconf(_SC_PAGESIZE), PROT_READ | PROT_WRITE))) {
+                return;
+            }
+            __atomic_store_n(slot, value, __ATOMIC_RELEASE);
+            if (is_read_only) {
+                mprotect(page, (size_t) sysconf(_SC_PAGESIZE), PROT_READ);
+            }
+        }
+
+    private:
+        // The dynamic section's addresses are relocated by glibc's loader, but not in every object (such as the vDSO)
+        static uintptr_t Address(const struct dl_phdr_info* info, ElfW(Addr) address) {
+            return (address < info->dlpi_addr) ? (uintptr_t) (info->dlpi_addr + address) : (uintptr_t) address;
+        }
+
+        static int SearchObject(struct dl_phdr_info* info, size_t, void* data) {
+            Search* search = (Search*) data;
+            const ElfW(Dyn)* dynamic = nullptr;
+            std::pair<uintptr_t, uintptr_t> relro(0, 0);
+            for (ElfW(Half) i = 0; i < info->dlpi_phnum; ++i) {
+                const ElfW(Phdr)& header = info->dlpi_phdr[i];
+                if (PT_DYNAMIC == header.p_type) {
+                    dynamic = (const ElfW(Dyn)*) (info->dlpi_addr + header.p_vaddr);
+                } else if (PT_GNU_RELRO == header.p_type) {
+                    relro = std::make_pair((uintptr_t) (info->dlpi_addr + header.p_vaddr),
+                                           (uintptr_t) (info->dlpi_addr + header.p_vaddr + header.p_memsz));
+                }
+            }
+            if (nullptr == dynamic) {
+                return 0;
+            }
+
+            const ElfW(Sym)* symbols = nullptr;
+            const char* strings = nullptr;
+            const GotRelocation* tables[2] = {};
+            size_t sizes[2] = {};
+            for (const ElfW(Dyn)* entry = dynamic; DT_NULL != entry->d_tag; ++entry) {
+                if (DT_SYMTAB == entry->d_tag) {
+                    symbols = (const ElfW(Sym)*) Address(info, entry->d_un.d_ptr);
+                } else if (DT_STRTAB == entry->d_tag) {
+                    strings = (const char*) Address(info, entry->d_un.d_ptr);
+                } else if (DT_JMPREL == entry->d_tag) {
+                    tables[0] = (const GotRelocation*) Address(info, entry->d_un.d_ptr);
+                } else if (DT_PLTRELSZ == entry->d_tag) {
+                    sizes[0] = entry->d_un.d_val;
+                } else if (g_got_relocations_tag == entry->d_tag) {
+                    tables[1] = (const GotRelocation*) Address(info, entry->d_un.d_ptr);
+                } else if (g_got_relocations_size_tag == entry->d_tag) {
+                    sizes[1] = entry->d_un.d_val;
+                }
+            }
+            if ((nullptr == symbols) || (nullptr == strings)) {
+                return 0;
+            }
+
+            size_t found = search->slots->size();
+            for (size_t table = 0; table < 2; ++table) {
+                for (size_t i = 0; (nullptr != tables[table]) && (i < sizes[table] / sizeof(GotRelocation)); ++i) {
+                    const GotRelocation& relocation = tables[table][i];
+                    unsigned type = RelocationType(relocation.r_info);
+                    size_t symbol = RelocationSymbol(relocation.r_info);
+                    if (((g_got_jump_slot != type) && (g_got_data != type)) || (0 == symbol) ||
+                        (0 != std::strcmp(strings + symbols[symbol].st_name, search->name))) {
+                        continue;
+                    }
+                    search->slots->push_back((void**) (info->dlpi_addr + relocation.r_offset));
+                }
+            }
+            if ((search->slots->size() > found) && (0 != relro.first)) {
+                search->read_only->push_back(relro);
+            }
+            return 0;
+        }
+    };
+
+    /********************************************************************
+        A hook written into the GOT slots of a function, removed when it
+        goes out of scope.
+    ********************************************************************/
+    class CScopedGotHook {
+    private:
+        struct Slot {
+            void** address;
+            void* previous;
+        };
+
+        std::vector<Slot> m_slots;
+        std::vector<std::pair<uintptr_t, uintptr_t> > m_read_only;
+        bool m_installed;
+
+    public:
+        /********************************************************************
+            @param original [OUT] Receives the address of the function, on
+                first install
+            @param name [IN] The function's symbol name
+            @param dst [IN] The function that will be called
+        ********************************************************************/
+        CScopedGotHook(void** original, const char* name, void* dst) : m_installed(false) {
+            std::lock_guard<std::mutex> lock(Mutex());
+            if (nullptr == *original) {
+                *original = dlsym(RTLD_DEFAULT, name);
+            }
+            for (void** slot : CGotTable::Find(name, &m_read_only)) {
+                m_slots.push_back({slot, *slot});
+            }
+            Write(dst);
+        }
+
+        void Replace(void* dst) {
+            std::lock_guard<std::mutex> lock(Mutex());
+            Write(dst);
+        }
+
+        // Restores what each slot held before this hook, so nested hooks on the same function unwind properly
+        void Remove() {
+            std::lock_guard<std::mutex> lock(Mutex());
+            if (!m_installed) {
+                return;
+            }
+            for (const Slot& slot : m_slots) {
+                CGotTable::Write(slot.address, slot.previous, m_read_only);
+            }
+            m_installed = false;
+        }
+
+        // The number of slots redirected, zero if no loaded object calls the function through the dynamic linker
+        size_t slots() const { return m_slots.size(); }
+
+        ~CScopedGotHook() {
+            Remove();
+        }
+
+    private:
+        static std::mutex& Mutex() {
+            static std::mutex mutex;
+            return mutex;
+        }
+
+        void Write(void* dst) {
+            for (const Slot& slot : m_slots) {
+                CGotTable::Write(slot.address, dst, m_read_only);
+            }
+            m_installed = true;
+        }
+
+        CScopedGotHook(const CScopedGotHook&) = delete;
+        CScopedGotHook& operator=(const CScopedGotHook&) = delete;
+    };
+
+}
+
+#endif //CUTIE_GOT_HOOK_HPP
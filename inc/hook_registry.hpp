@@ -0,0 +1,296 @@
+/********************************************************************
+	File name:	hook_registry.hpp
+	Project  :	Cutie
+	Author   :	Dor Cohen
+
+    A process-wide registry of hook sites.
+    Creating a Subhook hook allocates an executable trampoline and
+    disassembles the target's prologue. The registry does this once per
+    target function and caches the result, so installing, replacing and
+    removing hooks afterwards is just a rewrite of the jump.
+    Functions wrapped by the linker (see link_wrap.hpp) are registered
+    with the pointer their dispatcher jumps through instead, and hooking
+    them only stores to it.
+
+********************************************************************/
+#ifndef CUTIE_HOOK_REGISTRY_HPP
+#define CUTIE_HOOK_REGISTRY_HPP
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "code_patch.hpp"
+#include "code_patcher.hpp"
+
+namespace cutie {
+
+    /********************************************************************
+        A single hooked function.
+        Owns the Subhook handle (used only for its trampoline) and the
+        original bytes of the function's prologue.
+        A function wrapped by the linker has no Subhook handle, and neither
+        has a function Subhook can't create a hook for. Their handle is the
+        site's address, tagged with the lowest bit, so Trampoline() and
+        Source() can tell them apart.
+    ********************************************************************/
+    class CHookSite;
+
+    struct SitePatch {
+        CHookSite* site;
+        void* dst;
+    };
+
+    class CHookSite {
+    private:
+        // A scoped hook installed on the site, and what it restores when it's removed
+        struct ScopedEntry {
+            const void* owner;
+            void* previous_dst;
+        };
+
+        void* m_src;
+        void* m_dst;
+        subhook_t m_hook;
+        // The scoped hooks installed on the site, oldest first. The newest one is the installed destination.
+        std::vector<ScopedEntry> m_scoped;
+        unsigned char m_original[g_jump_size];
+        // The pointer the dispatcher of a wrapped function jumps through, and the function itself
+        void** m_wrap_target;
+        void* m_wrapped;
+
+    public:
+        explicit CHookSite(void* src)
+                : m_src(src), m_dst(nullptr), m_original(), m_wrap_target(nullptr), m_wrapped(nullptr) {
+            // The hook is never installed through Subhook, so its destination doesn't matter.
+            // If Subhook fails, the function is still patched by Cutie, only without a trampoline.
+            m_hook = subhook_new(m_src, m_src, (subhook_flags_t) (g_subhook_flags | SUBHOOK_TRAMPOLINE));
+            std::memcpy(m_original, m_src, sizeof(m_original));
+        }
+
+        CHookSite(void* src, void** wrap_target, void* wrapped)
+                : m_src(src), m_dst(nullptr), m_hook(nullptr), m_original(),
+                  m_wrap_target(wrap_target), m_wrapped(wrapped) {}
+
+        ~CHookSite() {
+            Patch(nullptr);
+            if (nullptr != m_hook) {
+                subhook_free(m_hook);
+            }
+        }
+
+        /********************************************************************
+            @brief Redirect the function to dst.
+
+            @param dst [IN] The new destination, or nullptr to restore
+                the original function
+            @return true on success. On failure, the function is left as it was.
+        ********************************************************************/
+        bool Patch(void* dst) {
+            std::lock_guard<std::recursive_mutex> lock(CCodePatcher::Instance().mutex());
+            if (dst == m_dst) {
+                return true;
+            }
+            SitePatch patch = {this, dst};
+            return PatchAll(&patch, 1);
+        }
+
+        /********************************************************************
+            @brief Redirect several sites as a single batch of code patches.
+                Patches are applied in order, so if a site appears more
+                than once, the last destination wins.
+
+            @return true on success. On failure, no site is patched.
+        ********************************************************************/
+        static bool PatchAll(const SitePatch* patches, size_t count) {
+            CCodePatcher& patcher = CCodePatcher::Instance();
+            std::lock_guard<std::recursive_mutex> lock(patcher.mutex());
+            std::vector<CodePatch> code;
+            std::vector<std::array<unsigned char, g_jump_size> > jumps(count);
+            for (size_t i = 0; i < count; ++i) {
+                CHookSite* site = patches[i].site;
+                void* dst = patches[i].dst;
+                if (site->is_wrapped()) {
+                    __atomic_store_n(site->m_wrap_target, (nullptr == dst) ? site->m_wrapped : dst, __ATOMIC_RELEASE);
+                    site->m_dst = dst;
+                    continue;
+                }
+                const unsigned char* bytes = site->m_original;
+                if (nullptr != dst) {
+                    EncodeJump(jumps[i].data(), site->m_src, dst);
+                    bytes = jumps[i].data();
+                }
+                code.push_back({site->m_src, bytes, g_jump_size});
+            }
+            if (!code.empty() && !patcher.Write(code.data(), code.size())) {
+                return false;
+            }
+            for (size_t i = 0; i < count; ++i) {
+                patches[i].site->m_dst = patches[i].dst;
+            }
+            return true;
+        }
+
+        /********************************************************************
+            @brief Install or replace a scoped hook. If newer scoped hooks
+                are installed, the function stays redirected to the newest,
+                and dst is restored when they're removed.
+
+            @param owner [IN] Identifies the hook, for Remove()
+            @param dst [IN] The hook's destination
+            @return true on success. On failure, the function is left as it was.
+        ********************************************************************/
+        bool Install(const void* owner, void* dst) {
+            std::lock_guard<std::recursive_mutex> lock(CCodePatcher::Instance().mutex());
+            size_t index = FindScoped(owner);
+            if (index == m_scoped.size()) {
+                void* previous_dst = m_dst;
+                if (!Patch(dst)) {
+                    return false;
+                }
+                m_scoped.push_back({owner, previous_dst});
+                return true;
+            }
+            if (index + 1 < m_scoped.size()) {
+                m_scoped[index + 1].previous_dst = dst;
+                return true;
+            }
+            return Patch(dst);
+        }
+
+        /********************************************************************
+            @brief Remove a scoped hook, in any order. Removing the newest
+                one restores what was installed before it. Removing an
+                older one only makes the next newer one restore what
+                the older one would have.
+
+            @param owner [IN] The owner given to Install()
+        ********************************************************************/
+        void Remove(const void* owner) {
+            std::lock_guard<std::recursive_mutex> lock(CCodePatcher::Instance().mutex());
+            size_t index = FindScoped(owner);
+            if (index == m_scoped.size()) {
+                return;
+            }
+            if (index + 1 == m_scoped.size()) {
+                Patch(m_scoped[index].previous_dst);
+            } else {
+                m_scoped[index + 1].previous_dst = m_scoped[index].previous_dst;
+            }
+            m_scoped.erase(m_scoped.begin() + (ptrdiff_t) index);
+        }
+
+        void* src() const { return m_src; }
+
+        void* dst() const { return m_dst; }
+
+        bool is_installed() const { return nullptr != m_dst; }
+
+        bool is_wrapped() const { return nullptr != m_wrap_target; }
+
+        subhook_t handle() const { return (nullptr != m_hook) ? m_hook : (subhook_t) ((uintptr_t) this | 1); }
+
+        void* trampoline() const {
+            if (is_wrapped()) {
+                return m_wrapped;
+            }
+            return (nullptr != m_hook) ? subhook_get_trampoline(m_hook) : nullptr;
+        }
+
+    private:
+        size_t FindScoped(const void* owner) const {
+            size_t index = 0;
+            while ((index < m_scoped.size()) && (m_scoped[index].owner != owner)) {
+                ++index;
+            }
+            return index;
+        }
+
+        CHookSite(const CHookSite&) = delete;
+        CHookSite& operator=(const CHookSite&) = delete;
+    };
+
+    /********************************************************************
+        The process-wide collection of hook sites, keyed by the hooked
+        function's address.
+    ********************************************************************/
+    class CHookRegistry {
+    private:
+        std::mutex m_mutex;
+        std::unordered_map<void*, std::unique_ptr<CHookSite> > m_sites;
+
+    public:
+        // Never destroyed, so hooks and trampolines stay valid during static destruction
+        static CHookRegistry& Instance() {
+            static CHookRegistry* instance = new CHookRegistry();
+            return *instance;
+        }
+
+        /********************************************************************
+            @brief Get the site of a function, creating it on first use.
+
+            @param src [IN] The function to hook
+        ********************************************************************/
+        CHookSite& Acquire(void* src) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::unique_ptr<CHookSite>& site = m_sites[src];
+            if (!site) {
+                site.reset(new CHookSite(src));
+            }
+            return *site;
+        }
+
+        /********************************************************************
+            @brief Register a function wrapped by the linker, before it's
+                hooked. Its hooks are stored to wrap_target from now on.
+
+            @param src [IN] The function's dispatcher, __wrap_func
+            @param wrap_target [IN] The pointer the dispatcher jumps through
+            @param wrapped [IN] The function itself, __real_func
+        ********************************************************************/
+        void Wrap(void* src, void** wrap_target, void* wrapped) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::unique_ptr<CHookSite>& site = m_sites[src];
+            if (!site) {
+                site.reset(new CHookSite(src, wrap_target, wrapped));
+            }
+        }
+
+        /********************************************************************
+            @brief Get the site of a function.
+
+            @param src [IN] The hooked function
+            @return The site, or nullptr if the function was never hooked
+        ********************************************************************/
+        CHookSite* Find(void* src) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto site = m_sites.find(src);
+            return (site == m_sites.end()) ? nullptr : site->second.get();
+        }
+
+    private:
+        CHookRegistry() = default;
+        CHookRegistry(const CHookRegistry&) = delete;
+        CHookRegistry& operator=(const CHookRegistry&) = delete;
+    };
+
+    // The original function of a hook's handle, nullptr if Subhook can't build a trampoline for it
+    inline void* Trampoline(subhook_t hook) {
+        if (0 != ((uintptr_t) hook & 1)) {
+            return ((const CHookSite*) ((uintptr_t) hook & ~(uintptr_t) 1))->trampoline();
+        }
+        return subhook_get_trampoline(hook);
+    }
+
+    // The hooked function of a hook's handle
+    inline void* Source(subhook_t hook) {
+        if (0 != ((uintptr_t) hook & 1)) {
+            return ((const CHookSite*) ((uintptr_t) hook & ~(uintptr_t) 1))->src();
+        }
+        return subhook_get_src(hook);
+    }
+
+}
+
+#endif //CUTIE_HOOK_REGISTRY_HPP
@@ -0,0 +1,228 @@
+/********************************************************************
+	File name:	latency.hpp
+	Project  :	Cutie
+	Author   :	Dor Cohen
+
+    Latency hooks: hooks with a generated stub that waits for a delay
+    drawn from a distribution, then forwards to the original function
+    through its trampoline.
+    Only used internally by DECLARE_LATENCY_HOOKABLE and
+    INSTALL_LATENCY_HOOK.
+
+********************************************************************/
+#ifndef CUTIE_LATENCY_HPP
+#define CUTIE_LATENCY_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <initializer_list>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "c_scoped_hook.hpp"
+#include "function_traits.hpp"
+
+namespace cutie {
+
+    /********************************************************************
+        A distribution of delays.
+        Delays are drawn from a pseudo-random generator with a fixed
+        seed, so a test sees the same delays on every run.
+    ********************************************************************/
+    class CLatency {
+    public:
+        typedef std::chrono::nanoseconds Duration;
+
+    private:
+        struct Point {
+            double percentile;
+            Duration delay;
+        };
+
+        // The delay at each percentile, ascending. Delays between two points are interpolated linearly.
+        std::vector<Point> m_points;
+        bool m_spin;
+        std::mt19937_64 m_random;
+
+        explicit CLatency(std::vector<Point> points)
+                : m_points(std::move(points)), m_spin(false), m_random() {}
+
+    public:
+        // Every call is delayed by the same time
+        static CLatency Fixed(Duration delay) {
+            return CLatency({{0, delay}, {100, delay}});
+        }
+
+        // Delays are spread evenly between min and max
+        static CLatency Uniform(Duration min, Duration max) {
+            return CLatency({{0, min}, {100, max}});
+        }
+
+        /********************************************************************
+            @brief Delays follow the given percentiles. For example,
+                {{50, 1ms}, {99, 20ms}, {100, 200ms}} is a median of 1ms,
+                with 1% of the calls taking 20ms to 200ms.
+                Calls below the first percentile take its delay.
+
+            @param percentiles [IN] Pairs of a percentile (0 to 100) and
+                its delay, in ascending order
+            @throw std::invalid_argument if a percentile is out of range,
+                or not above the previous one
+        ********************************************************************/
+        static CLatency Percentiles(std::initializer_list<std::pair<double, Duration> > percentiles) {
+            std::vector<Point> points;
+            for (const std::pair<double, Duration>& percentile : percentiles) {
+                if (!(percentile.first >= 0 && percentile.first <= 100)) {
+                    throw std::invalid_argument("Latency percentiles must be between 0 and 100");
+                }
+                if ((points.size() > 1) && (percentile.first <= points.back().percentile)) {
+                    throw std::invalid_argument("Latency percentiles must be in ascending order");
+                }
+                if (points.empty()) {
+                    points.push_back({0, percentile.second});
+                }
+                points.push_back({percentile.first, percentile.second});
+            }
+            if (points.empty()) {
+                points.push_back({0, Duration::zero()});
+            }
+            if (points.back().percentile < 100) {
+                points.push_back({100, points.back().delay});
+            }
+            return CLatency(std::move(points));
+        }
+
+        // Wait by busy looping instead of sleeping, for delays shorter than the scheduler's resolution
+        CLatency& spin() {
+            m_spin = true;
+            return *this;
+        }
+
+        // Draw a different sequence of delays
+        CLatency& seed(uint64_t value) {
+            m_random.seed(value);
+            return *this;
+        }
+
+        // Draw the next delay. Not thread-safe.
+        Duration Next() {
+            double percentile = std::uniform_real_distribution<double>(0, 100)(m_random);
+            for (size_t i = 1; i < m_points.size(); ++i) {
+                const Point& low = m_points[i - 1];
+                const Point& high = m_points[i];
+                if (percentile < high.percentile) {
+                    double fraction = (percentile - low.percentile) / (high.percentile - low.percentile);
+                    return low.delay + Duration((Duration::rep) (fraction * (high.delay - low.delay).count()));
+                }
+            }
+            return m_points.back().delay;
+        }
+
+        bool is_spinning() const { return m_spin; }
+
+        static void Wait(Duration delay, bool spin) {
+            if (delay <= Duration::zero()) {
+                return;
+            }
+            if (!spin) {
+                std::this_thread::sleep_for(delay);
+                return;
+            }
+            std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + delay;
+            while (std::chrono::steady_clock::now() < deadline) {
+            }
+        }
+    };
+
+    template<typename Tag, typename Signature>
+    class CLatencyHook;
+
+    /********************************************************************
+        A latency hook on a function with the given signature.
+        The state is static, as the stub must be a plain function, thus
+        only a single latency hook per function may be installed at a time.
+
+        Tag - A type unique to the hooked function
+    ********************************************************************/
+    template<typename Tag, typename R, typename... Args>
+    class CLatencyHook<Tag, R(Args...)> {
+    private:
+        typedef R (* Original)(Args...);
+
+        static inline subhook_t s_hook = nullptr;
+        // Set before the function is patched, as other threads may call it as soon as it is
+        static inline std::atomic<Original> s_src{nullptr};
+        static inline std::atomic<Original> s_original{nullptr};
+        static inline CLatency* s_latency = nullptr;
+        // Serializes drawing delays, the waits themselves run concurrently
+        static inline std::mutex s_mutex;
+        static inline std::atomic<size_t> s_calls{0};
+        static inline std::atomic<CLatency::Duration::rep> s_total_delay{0};
+
+        CLatency m_latency;
+        CScopedHookInstall m_install;
+
+    public:
+        CLatencyHook(void* func, const CLatency& latency)
+                : m_latency(latency), m_install(&s_hook, func, nullptr) {
+            s_calls.store(0);
+            s_total_delay.store(0);
+            s_src.store((Original) func);
+            s_original.store((Original) m_install.site().trampoline());
+            {
+                std::lock_guard<std::mutex> lock(s_mutex);
+                s_latency = &m_latency;
+            }
+            m_install.Replace((void*) Stub);
+        }
+
+        ~CLatencyHook() {
+            m_install.Remove();
+            std::lock_guard<std::mutex> lock(s_mutex);
+            s_latency = nullptr;
+        }
+
+        // The number of calls since the hook was installed
+        size_t calls() const {
+            return s_calls.load(std::memory_order_relaxed);
+        }
+
+        // The sum of the delays injected since the hook was installed
+        CLatency::Duration total_delay() const {
+            return CLatency::Duration(s_total_delay.load(std::memory_order_relaxed));
+        }
+
+    private:
+        static R Stub(Args... args) {
+            s_calls.fetch_add(1, std::memory_order_relaxed);
+            CLatency::Duration delay = CLatency::Duration::zero();
+            bool spin = false;
+            {
+                std::lock_guard<std::mutex> lock(s_mutex);
+                if (nullptr != s_latency) {
+                    delay = s_latency->Next();
+                    spin = s_latency->is_spinning();
+                }
+            }
+            s_total_delay.fetch_add(delay.count(), std::memory_order_relaxed);
+            CLatency::Wait(delay, spin);
+            Original original = s_original.load();
+            if (nullptr != original) {
+                return original(args...);
+            }
+            // Subhook couldn't build a trampoline for this function, fall back to removing the hook
+            CScopedHookRemove remove(&s_hook);
+            return s_src.load()(args...);
+        }
+
+        CLatencyHook(const CLatencyHook&) = delete;
+        CLatencyHook& operator=(const CLatencyHook&) = delete;
+    };
+
+}
+
+#endif //CUTIE_LATENCY_HPP
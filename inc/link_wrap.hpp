@@ -0,0 +1,77 @@
+/********************************************************************
+	File name:	link_wrap.hpp
+	Project  :	Cutie
+	Author   :	Dor Cohen
+
+    Hooks set up by the linker, for the functions given in the WRAP
+    list of add_cutie_test_target (see Cutie.cmake).
+    The test is linked with -Wl,--wrap=func, so the linker sends the
+    calls to func made from every object file of the test to
+    __wrap_func, and resolves __real_func to func itself. Cutie.cmake
+    generates a source defining, for each wrapped function, a pointer
+    to the function's current destination (initially __real_func), and
+    a __wrap_func that jumps through it.
+    The function is registered in the CHookRegistry before any test
+    code runs, so INSTALL_HOOK, mocks and the rest of Cutie's hooks
+    install a stub by storing its address in the pointer: no trampoline
+    is built, no code is patched, and other threads running the function
+    meanwhile are safe. The original function is __real_func.
+    Calls within the object file that defines the function, and calls
+    from shared libraries, aren't wrapped by the linker.
+    Only used by the sources generated by Cutie.cmake.
+
+********************************************************************/
+#ifndef CUTIE_LINK_WRAP_HPP
+#define CUTIE_LINK_WRAP_HPP
+
+#include "hook_registry.hpp"
+
+// The jump from __wrap_func through the pointer to its destination
+#if defined __x86_64__
+#define CUTIE_WRAP_JUMP(target) "jmp *" target "(%rip)\n"
+#elif defined __i386__
+// Position independent, so PIE tests have no text relocations: the pointer is loaded relative to the GOT, found
+// with a call/pop, and its destination replaces a slot pushed on the stack, so ret jumps to it with all registers
+// and the stack as the caller left them.
+#define CUTIE_WRAP_JUMP(target) \
+    "subl $4, %esp\n" \
+    "pushl %eax\n" \
+    "call 1f\n" \
+    "1:\n" \
+    "popl %eax\n" \
+    "addl $_GLOBAL_OFFSET_TABLE_ + (. - 1b), %eax\n" \
+    "movl " target "@GOTOFF(%eax), %eax\n" \
+    "movl %eax, 4(%esp)\n" \
+    "popl %eax\n" \
+    "ret\n"
+#elif defined __aarch64__
+#define CUTIE_WRAP_JUMP(target) "adrp x16, " target "\nldr x16, [x16, #:lo12:" target "]\nbr x16\n"
+#else
+#error Unsupported architecture
+#endif
+
+/********************************************************************
+	@brief Define the dispatcher of a function wrapped by the linker,
+		and register it as a hook site. Must be used once per function,
+		in a single source of the test.
+
+	@param func [IN] The function's symbol name
+********************************************************************/
+#define CUTIE_WRAP(func) \
+    extern "C" { \
+    void __real_##func(); \
+    void __wrap_##func(); \
+    void* __cutie_wrap__##func = (void*) &__real_##func; \
+    } \
+    __asm__(".text\n" \
+            ".globl __wrap_" #func "\n" \
+            ".type __wrap_" #func ", @function\n" \
+            "__wrap_" #func ":\n" \
+            CUTIE_WRAP_JUMP("__cutie_wrap__" #func) \
+            ".size __wrap_" #func ", . - __wrap_" #func "\n"); \
+    __attribute__((constructor(101))) static void __cutie_register_wrap__##func() { \
+        cutie::CHookRegistry::Instance().Wrap((void*) &__wrap_##func, &__cutie_wrap__##func, (void*) &__real_##func); \
+    } \
+    static_assert(true, "Semicolon required")
+
+#endif //CUTIE_LINK_WRAP_HPP
@@ -8,27 +8,149 @@
 #ifndef CUTIE_MOCK_CONTAINER_HPP
 #define CUTIE_MOCK_CONTAINER_HPP
 
+#include <atomic>
+#include <memory>
 #include <cmock/cmock.h>
 #include <hook.hpp>
+#include "call_statistics.hpp"
+#include "mock_timing.hpp"
 
 /********************************************************************
 	A base class for CMock containers.
 	Wraps SubHook's CScopedInstallHook class.
+	Mocker is CMock's mocker, or cutie::CAutoMocker for DECLARE_AUTO_MOCKABLE.
+	Records the time of every call made through the installed stub.
 	Only used internally by MockContainer_##func
 ********************************************************************/
-template<typename BaseClass>
-class MockContainer : public ::testing::NiceMock<CMockMocker<BaseClass> > {
+template<typename BaseClass, typename Mocker = CMockMocker<BaseClass> >
+class MockContainer : public ::testing::NiceMock<Mocker> {
+private:
+    // The latest container of the function, which records its calls
+    static inline BaseClass* s_current = nullptr;
+
 protected:
     MockContainer(void* func, void* stub) :
-            m_hook(), m_install(&m_hook, func, stub) {}
+            m_hook(), m_install(&m_hook, func, stub), m_lazy_stub(nullptr), m_previous(s_current),
+            m_has_fast_default(false), m_has_expectations(false) {
+        s_current = static_cast<BaseClass*>(this);
+    }
 
-    virtual ~MockContainer() {};
+    virtual ~MockContainer() {
+        s_current = m_previous;
+    }
 
 public:
+    static BaseClass* current() { return s_current; }
+
+    // The call statistics of the function, shared by its containers (see call_statistics.hpp)
+    static cutie::CCallStatistics& statistics() {
+        static cutie::CCallStatistics statistics(BaseClass::name(), "mock");
+        return statistics;
+    }
+
+    // The calls made to the mock since the container was created
+    cutie::CMockCallLog& calls() { return m_calls; }
+
     void set_stub(void* stub) {
+        m_lazy_stub = nullptr;
         m_install.Replace(stub);
     }
 
+    // Sets the stub without installing it. It's installed by arm(), or never, if arm() isn't called.
+    void set_lazy_stub(void* stub) {
+        m_lazy_stub = stub;
+    }
+
+    /********************************************************************
+        @brief Install the lazy stub, if it isn't installed yet.
+            Called by CUTIE_ON_CALL and CUTIE_ARM_MOCK.
+
+        @return The container, for setting expectations on it
+    ********************************************************************/
+    BaseClass& arm() {
+        if (nullptr != m_lazy_stub) {
+            set_stub(m_lazy_stub);
+        }
+        return static_cast<BaseClass&>(*this);
+    }
+
+    /********************************************************************
+        @brief Install the lazy stub, and dispatch all calls through GMock
+            from now on. Called by CUTIE_EXPECT_CALL.
+
+        @return The container, for setting expectations on it
+    ********************************************************************/
+    BaseClass& expect() {
+        m_has_expectations = true;
+        clear_fast_default();
+        return arm();
+    }
+
+    /********************************************************************
+        The action performed directly by the stub, bypassing GMock, while
+        the only behavior set on the mock is a default matching any
+        arguments. nullptr when calls must go through GMock.
+        F is the mock method's signature.
+        The stub keeps the returned copy while performing the action, so
+        the test may clear or replace it while other threads call the mock.
+        Loading the shared pointer atomically takes a lock, so it's only
+        loaded once the flag says a fast default is set.
+    ********************************************************************/
+    template<typename F>
+    std::shared_ptr<const ::testing::Action<F> > fast_default() const {
+        if (!m_has_fast_default.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return std::static_pointer_cast<const ::testing::Action<F> >(std::atomic_load(&m_fast_default));
+    }
+
+    // Ignored once an expectation is set, as the expectation must be matched by GMock
+    template<typename F>
+    void set_fast_default(const ::testing::Action<F>& action) {
+        if (m_has_expectations) {
+            return;
+        }
+        std::atomic_store(&m_fast_default,
+                          std::shared_ptr<const void>(std::make_shared<const ::testing::Action<F> >(action)));
+        m_has_fast_default.store(true, std::memory_order_release);
+    }
+
+    void clear_fast_default() {
+        m_has_fast_default.store(false, std::memory_order_release);
+        std::atomic_store(&m_fast_default, std::shared_ptr<const void>());
+    }
+
+    // The function's hook, set once the stub is installed
+    subhook_t* hook() { return &m_hook; }
+
+    // The original function, called through Subhook's trampoline. nullptr if Subhook can't build one for it.
+    void* trampoline() const { return (nullptr == m_hook) ? nullptr : cutie::Trampoline(m_hook); }
+
+    // Uninstalls the stub, until set_stub() is called again
+    void remove_stub() {
+        m_install.Remove();
+    }
+
+    // Sets the container's own default behaviors, which Mock::VerifyAndClear clears. None by default.
+    virtual void SetDefaultActions() {}
+
+    // Verifies and clears the container's expectations and default behaviors
+    bool verify_and_clear() {
+        clear_fast_default();
+        m_has_expectations = false;
+        // GMock tracks the object that declares the mock method, which is the mocker for CAutoMocker
+        bool container_verified = ::testing::Mock::VerifyAndClear(static_cast<BaseClass*>(this));
+        bool mocker_verified = ::testing::Mock::VerifyAndClear(static_cast<Mocker*>(this));
+        return container_verified && mocker_verified;
+    }
+
+    // Stops GMock from reporting the container if it's never destroyed
+    void allow_leak() {
+        // GMock tracks the object that declares the mock method, which is the mocker for CAutoMocker
+        ::testing::Mock::AllowLeak(static_cast<BaseClass*>(this));
+        ::testing::Mock::AllowLeak(static_cast<Mocker*>(this));
+    }
+
 private:
     MockContainer(const MockContainer&) = delete;
     MockContainer& operator=(const MockContainer&) = delete;
@@ -36,6 +158,74 @@ private:
 protected:
     subhook_t m_hook;
     cutie::CScopedHookInstall m_install;
+    void* m_lazy_stub;
+    BaseClass* m_previous;
+    cutie::CMockCallLog m_calls;
+    // An Action<F> of the mock method's signature, see fast_default()
+    std::shared_ptr<const void> m_fast_default;
+    // Whether m_fast_default is set, checked by every call before loading it
+    std::atomic<bool> m_has_fast_default;
+    // Whether CUTIE_EXPECT_CALL was used since the container was created or last verified
+    bool m_has_expectations;
 };
 
+namespace cutie {
+
+    /********************************************************************
+        A container shared by all tests in the binary.
+        Created on first use and never destroyed, so the mock object
+        and the hook are built only once.
+        Only used internally by CUTIE_SUITE_CONTAINER
+    ********************************************************************/
+    template<typename Container>
+    class CSuiteContainer {
+    public:
+        static Container& Instance() {
+            static Container* instance = Create();
+            return *instance;
+        }
+
+    private:
+        // Leaked on purpose, so GMock mustn't report it when the program exits
+        static Container* Create() {
+            Container* container = new Container();
+            container->allow_leak();
+            return container;
+        }
+    };
+
+    /********************************************************************
+        Installs a shared container for the lifetime of a test.
+        On destruction, verifies and clears the container's expectations
+        and default behaviors, and uninstalls it, so the next test starts
+        clean, and GoogleTest's own output between tests isn't mocked.
+        The calls recorded by the container are cleared, and its own
+        default behaviors are set again, on installation.
+        Only used internally by CUTIE_SUITE_CONTAINER
+    ********************************************************************/
+    template<typename Container>
+    class CScopedSuiteContainerInstall {
+    private:
+        Container& m_container;
+
+    public:
+        CScopedSuiteContainerInstall(Container& container, void* stub)
+                : m_container(container) {
+            m_container.calls().Clear();
+            m_container.SetDefaultActions();
+            m_container.set_stub(stub);
+        }
+
+        ~CScopedSuiteContainerInstall() {
+            m_container.verify_and_clear();
+            m_container.remove_stub();
+        }
+
+    private:
+        CScopedSuiteContainerInstall(const CScopedSuiteContainerInstall&) = delete;
+        CScopedSuiteContainerInstall& operator=(const CScopedSuiteContainerInstall&) = delete;
+    };
+
+}
+
 #endif // CUTIE_MOCK_CONTAINER_HPP
@@ -0,0 +1,257 @@
+/********************************************************************
+	File name:	mock_timing.hpp
+	Project  :	Cutie
+	Author   :	Dor Cohen
+
+    Timestamps of mocked calls, taken with a monotonic clock.
+    Every installed mock jumps to a generated stub that records when
+    the call started and ended, then forwards it to the mock.
+    The time spent inside mocks is also summed per thread, so the time
+    of the code under test can be measured without its mocks.
+
+********************************************************************/
+#ifndef CUTIE_MOCK_TIMING_HPP
+#define CUTIE_MOCK_TIMING_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <gmock/gmock.h>
+
+// The number of calls to each mock whose start and end are recorded
+#ifndef CUTIE_MOCK_CALL_LOG_SIZE
+#define CUTIE_MOCK_CALL_LOG_SIZE 64
+#endif
+
+namespace cutie {
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct MockCall {
+        Clock::time_point start;
+        Clock::time_point end;
+    };
+
+    /********************************************************************
+        The calls to a single mock, in the order they started.
+        Only the first CUTIE_MOCK_CALL_LOG_SIZE calls are timed, in a
+        fixed array, so recording a call takes no lock and no allocation.
+        Later calls are only counted.
+    ********************************************************************/
+    class CMockCallLog {
+    public:
+        static constexpr size_t g_size = CUTIE_MOCK_CALL_LOG_SIZE;
+
+    private:
+        struct Entry {
+            MockCall call;
+            std::atomic<bool> done;
+        };
+
+        std::atomic<size_t> m_count;
+        Entry m_entries[g_size];
+
+    public:
+        CMockCallLog() : m_count(0), m_entries() {}
+
+        // Only used internally by CTimedStub. Returns the index of the call.
+        size_t Start() {
+            return m_count.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void Record(size_t index, const MockCall& call) {
+            if (index < g_size) {
+                m_entries[index].call = call;
+                m_entries[index].done.store(true, std::memory_order_release);
+            }
+        }
+
+        // Must not be called while the mock is called
+        void Clear() {
+            for (size_t i = 0; (i < count()) && (i < g_size); ++i) {
+                m_entries[i].done.store(false, std::memory_order_relaxed);
+            }
+            m_count.store(0, std::memory_order_relaxed);
+        }
+
+        size_t count() const {
+            return m_count.load(std::memory_order_relaxed);
+        }
+
+        // Whether the call happened, was timed, and has returned
+        bool is_timed(size_t index) const {
+            return (index < g_size) && m_entries[index].done.load(std::memory_order_acquire);
+        }
+
+        // Throws std::out_of_range if there was no such call, if it hasn't returned yet, or if it wasn't timed
+        MockCall at(size_t index) const {
+            if (!is_timed(index)) {
+                throw std::out_of_range("call #" + std::to_string(index) + " wasn't timed");
+            }
+            return m_entries[index].call;
+        }
+    };
+
+    /********************************************************************
+        The time the calling thread spent inside mocks.
+        Nested mocked calls (a mock whose action calls another mock)
+        are counted once.
+    ********************************************************************/
+    class CMockTime {
+    private:
+        static inline thread_local Clock::duration s_total{};
+        static inline thread_local size_t s_depth = 0;
+
+    public:
+        static Clock::duration total() { return s_total; }
+
+        // Only used internally by CTimedStub
+        static void Enter() { ++s_depth; }
+
+        static void Leave(Clock::duration duration) {
+            if (0 == --s_depth) {
+                s_total += duration;
+            }
+        }
+    };
+
+    /********************************************************************
+        Measures the time since construction, on the calling thread.
+    ********************************************************************/
+    class CStopwatch {
+    private:
+        Clock::time_point m_start;
+        Clock::duration m_mocks_at_start;
+
+    public:
+        CStopwatch() : m_start(Clock::now()), m_mocks_at_start(CMockTime::total()) {}
+
+        Clock::duration elapsed() const {
+            return Clock::now() - m_start;
+        }
+
+        // The time since construction, minus the time this thread spent inside mocks meanwhile
+        Clock::duration elapsed_excluding_mocks() const {
+            return elapsed() - (CMockTime::total() - m_mocks_at_start);
+        }
+    };
+
+    template<typename Rep, typename Period>
+    std::string FormatDuration(std::chrono::duration<Rep, Period> duration) {
+        std::ostringstream text;
+        text << std::chrono::duration_cast<std::chrono::duration<double, std::micro> >(duration).count() << "us";
+        return text.str();
+    }
+
+    /********************************************************************
+        @brief Check that a duration is shorter than a limit.
+            Used by EXPECT_SHORTER_THAN.
+    ********************************************************************/
+    template<typename Duration, typename Limit>
+    ::testing::AssertionResult IsShorterThan(Duration duration, Limit limit) {
+        if (duration < limit) {
+            return ::testing::AssertionSuccess();
+        }
+        return ::testing::AssertionFailure()
+                << "took " << FormatDuration(duration) << ", expected less than " << FormatDuration(limit);
+    }
+
+    /********************************************************************
+        @brief Check that the index-th call to a mock started within a
+            limit after a time point. Used by EXPECT_MOCK_CALL_WITHIN.
+
+        @param log [IN] The calls to the mock
+        @param index [IN] The index of the call, starting from 0
+        @param since [IN] The time point, usually the time of another call
+        @param limit [IN] The longest time allowed between them
+    ********************************************************************/
+    template<typename Limit>
+    ::testing::AssertionResult IsCallWithin(const CMockCallLog& log, size_t index, Clock::time_point since,
+                                            Limit limit) {
+        size_t count = log.count();
+        if (index >= count) {
+            return ::testing::AssertionFailure()
+                    << "call #" << index << " never happened, there were " << count << " calls";
+        }
+        if (index >= CMockCallLog::g_size) {
+            return ::testing::AssertionFailure()
+                    << "call #" << index << " wasn't timed, only the first " << CMockCallLog::g_size
+                    << " calls are (see CUTIE_MOCK_CALL_LOG_SIZE)";
+        }
+        if (!log.is_timed(index)) {
+            return ::testing::AssertionFailure() << "call #" << index << " hasn't returned";
+        }
+        Clock::duration delay = log.at(index).start - since;
+        if (delay < Clock::duration::zero()) {
+            return ::testing::AssertionFailure()
+                    << "call #" << index << " happened " << FormatDuration(-delay) << " before";
+        }
+        if (delay > limit) {
+            return ::testing::AssertionFailure()
+                    << "call #" << index << " happened " << FormatDuration(delay) << " after, expected within "
+                    << FormatDuration(limit);
+        }
+        return ::testing::AssertionSuccess();
+    }
+
+    template<typename Container, typename Signature>
+    struct CTimedStub;
+
+    /********************************************************************
+        Generates the stub installed by mocks, which records the call
+        in the current container of the mocked function, and forwards
+        it to CMock's stub, or performs the container's fast default
+        action instead, if set.
+        Only used internally by DECLARE_MOCKABLE and DECLARE_AUTO_MOCKABLE.
+    ********************************************************************/
+    template<typename Container, typename R, typename... Args>
+    struct CTimedStub<Container, R(Args...)> {
+        template<R (* Stub)(Args...)>
+        static R Call(Args... args) {
+            Container* container = Container::current();
+            CTimedCall call(container);
+            std::shared_ptr<const ::testing::Action<R(Args...)> > action;
+            if (nullptr != container) {
+                action = container->template fast_default<R(Args...)>();
+            }
+            if (nullptr != action) {
+                return action->Perform(std::tuple<Args...>(args...));
+            }
+            return Stub(args...);
+        }
+
+    private:
+        class CTimedCall {
+        private:
+            Container* m_container;
+            size_t m_index;
+            Clock::time_point m_start;
+
+        public:
+            explicit CTimedCall(Container* container)
+                    : m_container(container), m_index((nullptr != container) ? container->calls().Start() : 0),
+                      m_start(Clock::now()) {
+                CMockTime::Enter();
+            }
+
+            ~CTimedCall() {
+                Clock::time_point end = Clock::now();
+                CMockTime::Leave(end - m_start);
+                if (nullptr != m_container) {
+                    m_container->calls().Record(m_index, {m_start, end});
+                }
+#ifdef CUTIE_CALL_STATISTICS
+                Container::statistics().AddCall(end - m_start);
+#endif
+            }
+        };
+    };
+
+}
+
+#endif //CUTIE_MOCK_TIMING_HPP
@@ -0,0 +1,419 @@
+/********************************************************************
+	File name:	record_replay.hpp
+	Project  :	Cutie
+	Author   :	Dor Cohen
+
+    Recording the calls to a mocked function into a call log, and
+    replaying them from it.
+    A recording is the default behavior of a mock: it calls the original
+    function through its trampoline, and logs the arguments, the result
+    and errno. A replay serves the logged results instead, without
+    calling the original function, and fails the test if the code under
+    test calls it with different arguments than were recorded.
+    Only used internally by CUTIE_RECORD, CUTIE_REPLAY and
+    CUTIE_RECORD_OR_REPLAY.
+
+********************************************************************/
+#ifndef CUTIE_RECORD_REPLAY_HPP
+#define CUTIE_RECORD_REPLAY_HPP
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <gmock/gmock.h>
+#include "c_scoped_hook.hpp"
+#include "call_log.hpp"
+#include "call_statistics.hpp"
+
+namespace cutie {
+
+    // What's known of an argument's type, for checking how it may be recorded
+    struct ArgumentType {
+        bool is_pointer;
+        bool is_const_pointee;
+        bool is_integral;
+        size_t pointee_size;
+    };
+
+    // The size of a pointed type, or 0 if it's void, a function or incomplete (such as an opaque handle)
+    template<typename T, typename = void>
+    struct PointeeSize {
+        static constexpr size_t value = 0;
+    };
+
+    template<typename T>
+    struct PointeeSize<T, std::enable_if_t<!std::is_void_v<T> && !std::is_function_v<T>, std::void_t<decltype(sizeof(T))> > > {
+        static constexpr size_t value = sizeof(T);
+    };
+
+    template<typename T>
+    constexpr ArgumentType TypeOfArgument() {
+        if constexpr (std::is_pointer_v<T>) {
+            typedef std::remove_pointer_t<T> Pointee;
+            return {true, std::is_const_v<Pointee>, false, PointeeSize<Pointee>::value};
+        } else {
+            return {false, false, std::is_integral_v<T>, 0};
+        }
+    }
+
+    // An argument (or a result) of a single call
+    struct ArgumentView {
+        const void* address;
+        size_t size;
+        // The argument's value, if it's a pointer
+        const void* pointer;
+        // The argument's value, if it's a non-negative integer
+        bool has_size;
+        size_t size_value;
+        bool is_negative;
+    };
+
+    template<typename T>
+    ArgumentView ViewOfArgument(const T& argument) {
+        static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable arguments can be recorded");
+        ArgumentView view{&argument, sizeof(T), nullptr, false, 0, false};
+        if constexpr (std::is_pointer_v<T>) {
+            view.pointer = (const void*) argument;
+        } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+            view.is_negative = (argument < 0);
+            view.has_size = !view.is_negative;
+            view.size_value = (size_t) argument;
+        } else if constexpr (std::is_integral_v<T>) {
+            view.has_size = true;
+            view.size_value = (size_t) argument;
+        }
+        return view;
+    }
+
+    // Marks a recording as in a call on the calling thread, for its own lifetime
+    class CScopedActiveCall {
+    private:
+        // The recordings in a call on this thread, innermost last
+        static inline thread_local std::vector<const void*> t_active;
+
+    public:
+        explicit CScopedActiveCall(const void* recording) {
+            t_active.push_back(recording);
+        }
+
+        ~CScopedActiveCall() {
+            t_active.pop_back();
+        }
+
+        static bool IsActive(const void* recording) {
+            return t_active.end() != std::find(t_active.begin(), t_active.end(), recording);
+        }
+    };
+
+    template<typename Signature>
+    class CRecording;
+
+    /********************************************************************
+        The recording or the replay of a mocked function.
+        Must be destroyed before the function's container.
+    ********************************************************************/
+    template<typename R, typename... Args>
+    class CRecording<R(Args...)> {
+    public:
+        enum class Mode {
+            Record,
+            Replay,
+        };
+
+    private:
+        static_assert(std::is_void_v<R> || (std::is_trivially_copyable_v<R> && std::is_default_constructible_v<R>),
+                      "Only functions with trivially copyable results can be recorded");
+
+        typedef R (* Function)(Args...);
+        static constexpr size_t g_arity = sizeof...(Args);
+        // Grows once if a call's buffers don't fit
+        static constexpr size_t g_initial_record_capacity = 4096;
+        typedef std::array<ArgumentView, g_arity> ArgumentViews;
+
+        std::string m_name;
+        Mode m_mode;
+        bool m_active;
+        std::mutex m_mutex;
+        size_t m_calls;
+        std::vector<RecordedArgument> m_arguments;
+        std::array<ArgumentType, g_arity> m_types;
+        CCallLogWriter m_writer;
+        // The record being built, reused by every call so recording doesn't allocate within the mocked call
+        std::vector<uint8_t> m_record;
+        CCallLogReader m_reader;
+        LoggedCall m_call;
+        Function m_function;
+        Function m_original;
+        subhook_t* m_hook;
+        CCallStatistics* m_statistics;
+
+    public:
+        /********************************************************************
+            @brief Record or replay the calls to a mocked function, as its
+                default behavior.
+
+            @param name [IN] The function's name, for failure messages
+            @param mode [IN] Whether to record or replay
+            @param function [IN] The mocked function
+            @param container [IN] The function's container, which is installed
+            @param spec [IN] Makes an ON_CALL() spec on the container's mock
+                method, given its matchers
+            @param path [IN] The call log, which is replaced when recording
+            @param buffers [IN] The buffers to record (RecordedArgument),
+                besides the arguments themselves. Ignored when replaying,
+                as the log lists them.
+        ********************************************************************/
+        template<typename Container, typename SpecMaker, typename... Buffers>
+        CRecording(const char* name, Mode mode, Function function, Container& container, SpecMaker spec,
+                   const std::string& path, const Buffers&... buffers)
+                : m_name(name), m_mode(mode), m_active(false), m_calls(0), m_arguments(),
+                  m_types{TypeOfArgument<Args>()...}, m_call(), m_function(function), m_original(nullptr),
+                  m_hook(container.hook()), m_statistics(&Container::statistics()) {
+            container.arm();
+            // The recording is the newest default, so it takes precedence over a fast default set earlier
+            container.clear_fast_default();
+            m_original = (Function) container.trampoline();
+            m_active = (Mode::Record == m_mode) ? OpenRecording(path, {buffers...}) : OpenReplay(path);
+            spec(::testing::A<Args>()...)
+                    .InternalDefaultActionSetAt(__FILE__, __LINE__, name, m_mode == Mode::Record ? "record" : "replay")
+                    .WillByDefault(::testing::Invoke([this](Args... args) { return Call(args...); }));
+        }
+
+        ~CRecording() {
+            if (Mode::Replay == m_mode && m_active && m_reader.Next(&m_call)) {
+                ADD_FAILURE() << m_name << " was called " << m_calls << " times, but more calls were recorded";
+            }
+        }
+
+        // The number of calls recorded or replayed so far
+        size_t calls() {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_calls;
+        }
+
+        // The mode of CUTIE_RECORD_OR_REPLAY: recording if the CUTIE_RECORD environment variable is set
+        static Mode ModeFromEnvironment() {
+            return (nullptr != std::getenv("CUTIE_RECORD")) ? Mode::Record : Mode::Replay;
+        }
+
+    private:
+        bool OpenRecording(const std::string& path, std::initializer_list<RecordedArgument> buffers) {
+            for (uint32_t i = 0; i < g_arity; ++i) {
+                m_arguments.push_back({i, RecordedArgument::Value, 0});
+            }
+            for (const RecordedArgument& buffer : buffers) {
+                std::string error = Validate(buffer);
+                if (!error.empty()) {
+                    ADD_FAILURE() << "Can't record argument #" << buffer.argument << " of " << m_name << ": " << error;
+                    continue;
+                }
+                m_arguments[buffer.argument] = buffer;
+            }
+            if (!m_writer.Open(path, m_arguments)) {
+                ADD_FAILURE() << "Can't record " << m_name << " to " << path << ": " << std::strerror(errno);
+                return false;
+            }
+            m_record.reserve(g_initial_record_capacity);
+            return true;
+        }
+
+        bool OpenReplay(const std::string& path) {
+            std::string error;
+            if (!m_reader.Open(path, &error)) {
+                ADD_FAILURE() << "Can't replay " << m_name << ": " << error;
+                return false;
+            }
+            if (g_arity != m_reader.arguments().size()) {
+                ADD_FAILURE() << "Can't replay " << m_name << ": " << path << " was recorded with "
+                              << m_reader.arguments().size() << " arguments";
+                return false;
+            }
+            for (const RecordedArgument& argument : m_reader.arguments()) {
+                std::string argument_error = Validate(argument);
+                if (!argument_error.empty()) {
+                    ADD_FAILURE() << "Can't replay " << m_name << ": argument #" << argument.argument << ": "
+                                  << argument_error;
+                    return false;
+                }
+            }
+            m_arguments = m_reader.arguments();
+            // Each call reads its arguments into m_call, which mustn't allocate within the mocked call either
+            m_call.arguments.reserve(g_arity);
+            return true;
+        }
+
+        std::string Validate(const RecordedArgument& argument) const {
+            if (argument.argument >= g_arity) {
+                return "there's no such argument";
+            }
+            if (RecordedArgument::Value == argument.kind || RecordedArgument::Unchecked == argument.kind) {
+                return "";
+            }
+            const ArgumentType& type = m_types[argument.argument];
+            if (!type.is_pointer) {
+                return "it isn't a pointer";
+            }
+            if (RecordedArgument::OutputBuffer == argument.kind && type.is_const_pointee) {
+                return "it points to const, so it isn't an output";
+            }
+            if (g_pointee_size == argument.size_argument) {
+                return (RecordedArgument::OutputBuffer == argument.kind && 0 != type.pointee_size)
+                       ? "" : "the size of the pointed type is unknown, give a size argument";
+            }
+            if (argument.size_argument >= g_arity || !m_types[argument.size_argument].is_integral) {
+                return "its size argument isn't an integer argument";
+            }
+            return "";
+        }
+
+        R Call(Args... args) {
+            // Calls a recording makes to its own function, such as write() reporting a mismatch, run the original.
+            // Other recordings, even of functions with the same signature, still record or replay their calls.
+            if (CScopedActiveCall::IsActive(this)) {
+                return CallOriginal(args...);
+            }
+            CScopedActiveCall in_call(this);
+            ArgumentViews views{ViewOfArgument(args)...};
+            if (!m_active) {
+                return R();
+            }
+            if (Mode::Replay == m_mode) {
+                return Replay(views);
+            }
+            if constexpr (std::is_void_v<R>) {
+                CallOriginal(args...);
+                int error = errno;
+                Record(views, nullptr, error);
+                errno = error;
+            } else {
+                R result = CallOriginal(args...);
+                int error = errno;
+                ArgumentView result_view = ViewOfArgument(result);
+                Record(views, &result_view, error);
+                errno = error;
+                return result;
+            }
+        }
+
+        R CallOriginal(Args... args) {
+#ifdef CUTIE_CALL_STATISTICS
+            COriginalCallTimer timer(*m_statistics);
+#endif
+            if (nullptr != m_original) {
+                return m_original(args...);
+            }
+            // Subhook couldn't build a trampoline for this function, fall back to removing the hook
+            CScopedHookRemove remove(m_hook);
+            return m_function(args...);
+        }
+
+        // The number of bytes of a buffer argument, as recorded after the call
+        size_t BufferSize(const RecordedArgument& argument, const ArgumentViews& views,
+                          const ArgumentView* result) const {
+            if (nullptr == views[argument.argument].pointer) {
+                return 0;
+            }
+            if (RecordedArgument::InputBuffer == argument.kind) {
+                return views[argument.size_argument].size_value;
+            }
+            if (nullptr != result && result->is_negative) {
+                return 0;
+            }
+            size_t capacity = BufferCapacity(argument, views);
+            if (g_pointee_size != argument.size_argument && nullptr != result && result->has_size) {
+                return std::min(result->size_value, capacity);
+            }
+            return capacity;
+        }
+
+        size_t BufferCapacity(const RecordedArgument& argument, const ArgumentViews& views) const {
+            if (g_pointee_size == argument.size_argument) {
+                return m_types[argument.argument].pointee_size;
+            }
+            return views[argument.size_argument].size_value;
+        }
+
+        void Record(const ArgumentViews& views, const ArgumentView* result, int error) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::vector<uint8_t>& record = m_record;
+            record.clear();
+            CCallLogWriter::AppendU32(record, (uint32_t) error);
+            if (nullptr != result) {
+                CCallLogWriter::AppendSpan(record, result->address, result->size);
+            } else {
+                CCallLogWriter::AppendSpan(record, nullptr, 0);
+            }
+            for (const RecordedArgument& argument : m_arguments) {
+                const ArgumentView& view = views[argument.argument];
+                if (RecordedArgument::InputBuffer == argument.kind || RecordedArgument::OutputBuffer == argument.kind) {
+                    CCallLogWriter::AppendSpan(record, view.pointer, BufferSize(argument, views, result));
+                } else if (m_types[argument.argument].is_pointer) {
+                    uint8_t is_set = (nullptr != view.pointer);
+                    CCallLogWriter::AppendSpan(record, &is_set, sizeof(is_set));
+                } else {
+                    CCallLogWriter::AppendSpan(record, view.address, view.size);
+                }
+            }
+            m_writer.AppendRecord(record);
+            ++m_calls;
+        }
+
+        R Replay(const ArgumentViews& views) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            size_t index = m_calls++;
+            if (!m_reader.Next(&m_call)) {
+                ADD_FAILURE() << m_name << " was called more than the " << index << " recorded times";
+                return R();
+            }
+            for (const RecordedArgument& argument : m_arguments) {
+                if (!ReplayArgument(argument, views, m_call.arguments[argument.argument])) {
+                    ADD_FAILURE() << "Call #" << index << " to " << m_name << " doesn't match the recording: argument #"
+                                  << argument.argument << " differs";
+                }
+            }
+            errno = m_call.error;
+            if constexpr (!std::is_void_v<R>) {
+                R result{};
+                std::memcpy(&result, m_call.result.data, std::min(sizeof(R), (size_t) m_call.result.size));
+                return result;
+            }
+        }
+
+        // Compares an input to the recording, or writes an output from it. Returns false if they differ.
+        bool ReplayArgument(const RecordedArgument& argument, const ArgumentViews& views, const LogSpan& recorded) {
+            const ArgumentView& view = views[argument.argument];
+            if (RecordedArgument::Unchecked == argument.kind) {
+                return true;
+            }
+            if (RecordedArgument::OutputBuffer == argument.kind) {
+                if (nullptr == view.pointer) {
+                    return 0 == recorded.size;
+                }
+                size_t capacity = BufferCapacity(argument, views);
+                std::memcpy((void*) view.pointer, recorded.data, std::min(capacity, (size_t) recorded.size));
+                return recorded.size <= capacity;
+            }
+            if (RecordedArgument::InputBuffer == argument.kind) {
+                size_t size = BufferSize(argument, views, nullptr);
+                return size == recorded.size && 0 == std::memcmp(view.pointer, recorded.data, size);
+            }
+            if (m_types[argument.argument].is_pointer) {
+                return 1 == recorded.size && (nullptr != view.pointer) == (0 != recorded.data[0]);
+            }
+            return view.size == recorded.size && 0 == std::memcmp(view.address, recorded.data, view.size);
+        }
+
+        CRecording(const CRecording&) = delete;
+        CRecording& operator=(const CRecording&) = delete;
+    };
+
+}
+
+#endif //CUTIE_RECORD_REPLAY_HPP
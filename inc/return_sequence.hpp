@@ -0,0 +1,85 @@
+/********************************************************************
+	File name:	return_sequence.hpp
+	Project  :	Cutie
+	Author   :	Dor Cohen
+
+    A single expectation returning a sequence of values, one per call.
+    Setting an expectation per call (with WillOnce()) allocates each
+    of them, and GMock scans all of them on every call, so tests
+    expecting many calls slow down quadratically. The sequence is kept
+    in one array instead, and each call advances an index into it.
+    Only used internally by CUTIE_EXPECT_SEQUENCE.
+
+********************************************************************/
+#ifndef CUTIE_RETURN_SEQUENCE_HPP
+#define CUTIE_RETURN_SEQUENCE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include <gmock/gmock.h>
+
+namespace cutie {
+
+    /********************************************************************
+        The action of a sequence expectation. Copies of the action (as
+        GMock makes) share the values and the index of the next one.
+    ********************************************************************/
+    template<typename R>
+    class CReturnSequence {
+    private:
+        struct State {
+            std::vector<R> values;
+            // GMock performs actions outside its lock, so concurrent calls take their indexes atomically
+            std::atomic<size_t> next;
+        };
+
+        std::shared_ptr<State> m_state;
+
+    public:
+        template<typename Range>
+        explicit CReturnSequence(const Range& values) : m_state(std::make_shared<State>()) {
+            using std::begin;
+            using std::end;
+            m_state->values.assign(begin(values), end(values));
+            m_state->next.store(0, std::memory_order_relaxed);
+        }
+
+        size_t size() const { return m_state->values.size(); }
+
+        template<typename... Args>
+        R operator()(const Args&...) const {
+            size_t index = m_state->next.fetch_add(1, std::memory_order_relaxed);
+            // GMock reports the calls beyond the sequence, but still performs the action
+            if (index >= m_state->values.size()) {
+                return ::testing::DefaultValue<R>::Get();
+            }
+            return m_state->values[index];
+        }
+    };
+
+    /********************************************************************
+        @brief Make an expectation return the given values, in order, one
+            per call, and expect exactly as many calls.
+
+        @param expectation [IN] An EXPECT_CALL() without clauses
+        @param values [IN] The values to return, any range convertible to
+            the result of the function
+        @return The expectation, for adding more clauses (such as After())
+    ********************************************************************/
+    template<typename F, typename Range>
+    ::testing::internal::TypedExpectation<F>& ExpectSequence(::testing::internal::TypedExpectation<F>& expectation,
+                                                              const Range& values) {
+        typedef typename ::testing::internal::Function<F>::Result Result;
+        static_assert(!std::is_void_v<Result>, "CUTIE_EXPECT_SEQUENCE requires a function that returns a value");
+
+        CReturnSequence<Result> sequence(values);
+        return expectation.Times((int) sequence.size()).WillRepeatedly(::testing::Invoke(sequence));
+    }
+
+}
+
+#endif //CUTIE_RETURN_SEQUENCE_HPP
@@ -0,0 +1,101 @@
+/********************************************************************
+	File name:	spy.hpp
+	Project  :	Cutie
+	Author   :	Dor Cohen
+
+    Lightweight spies: hooks with a generated stub that counts calls,
+    optionally records their arguments, and forwards to the original
+    function through its trampoline.
+    Only used internally by DECLARE_COUNTABLE and INSTALL_SPY.
+
+********************************************************************/
+#ifndef CUTIE_SPY_HPP
+#define CUTIE_SPY_HPP
+
+#include <array>
+#include <atomic>
+#include <tuple>
+#include <type_traits>
+#include "c_scoped_hook.hpp"
+#include "function_traits.hpp"
+
+namespace cutie {
+
+    template<typename Tag, typename Signature, size_t Capacity>
+    class CSpy;
+
+    /********************************************************************
+        A spy on a function with the given signature.
+        The state is static, as the stub must be a plain function, thus
+        only a single spy per function may be installed at a time.
+
+        Tag      - A type unique to the spied function
+        Capacity - The number of most recent calls whose arguments are
+                   recorded. Zero means only counting.
+    ********************************************************************/
+    template<typename Tag, size_t Capacity, typename R, typename... Args>
+    class CSpy<Tag, R(Args...), Capacity> {
+    public:
+        typedef std::tuple<typename std::decay<Args>::type...> Arguments;
+
+    private:
+        typedef R (* Original)(Args...);
+
+        static inline subhook_t s_hook = nullptr;
+        // Set before the function is patched, as other threads may call it as soon as it is
+        static inline std::atomic<Original> s_src{nullptr};
+        static inline std::atomic<Original> s_original{nullptr};
+        static inline std::atomic<size_t> s_calls{0};
+        // Written without synchronization. Concurrent calls may tear a record, but never the counter.
+        static inline std::array<Arguments, Capacity> s_records{};
+
+        CScopedHookInstall m_install;
+
+    public:
+        explicit CSpy(void* func)
+                : m_install(&s_hook, func, nullptr) {
+            s_calls.store(0);
+            s_src.store((Original) func);
+            s_original.store((Original) m_install.site().trampoline());
+            m_install.Replace((void*) Stub);
+        }
+
+        // The number of calls since the spy was installed
+        size_t calls() const {
+            return s_calls.load(std::memory_order_relaxed);
+        }
+
+        // Whether the arguments of the index-th call (0-based) are still in the ring buffer
+        bool is_captured(size_t index) const {
+            size_t total = calls();
+            return (index < total) && (total - index <= Capacity);
+        }
+
+        // The arguments of the index-th call (0-based). Valid only if is_captured(index).
+        const Arguments& arguments(size_t index) const {
+            static_assert(Capacity > 0, "Declare the function with DECLARE_COUNTABLE_WITH_CAPTURE to capture arguments");
+            return s_records[index % Capacity];
+        }
+
+    private:
+        static R Stub(Args... args) {
+            size_t index = s_calls.fetch_add(1, std::memory_order_relaxed);
+            if constexpr (Capacity > 0) {
+                s_records[index % Capacity] = Arguments(args...);
+            }
+            Original original = s_original.load();
+            if (nullptr != original) {
+                return original(args...);
+            }
+            // Subhook couldn't build a trampoline for this function, fall back to removing the hook
+            CScopedHookRemove remove(&s_hook);
+            return s_src.load()(args...);
+        }
+
+        CSpy(const CSpy&) = delete;
+        CSpy& operator=(const CSpy&) = delete;
+    };
+
+}
+
+#endif //CUTIE_SPY_HPP
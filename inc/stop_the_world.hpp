@@ -0,0 +1,212 @@
+/********************************************************************
+	File name:	stop_the_world.hpp
+	Project  :	Cutie
+	Author   :	Dor Cohen
+
+    Suspends all other threads of the process while code is patched.
+    Each thread is sent a signal, whose handler parks the thread on a
+    futex until the patch is done. The handler also records where the thread was
+    interrupted, so a thread that is in the middle of the patched
+    instructions is let go and the stop is retried.
+
+    Linux only, as threads are enumerated through /proc/self/task.
+
+********************************************************************/
+#ifndef CUTIE_STOP_THE_WORLD_HPP
+#define CUTIE_STOP_THE_WORLD_HPP
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <climits>
+#include <dirent.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#ifndef CUTIE_STOP_THE_WORLD_SIGNAL
+#define CUTIE_STOP_THE_WORLD_SIGNAL (SIGRTMIN + 4)
+#endif
+
+namespace cutie {
+
+    // The start address and size of patched code
+    typedef std::pair<uintptr_t, size_t> CodeRange;
+
+    class CStopTheWorld {
+    private:
+        static constexpr int g_max_attempts = 100;
+        // Threads beyond this count are still parked, but where they were interrupted is not checked
+        static constexpr int g_max_threads = 4096;
+        static constexpr std::chrono::milliseconds g_park_timeout{1000};
+
+        static inline std::atomic<int> s_released{1};
+        static inline std::atomic<int> s_parked{0};
+        static inline std::atomic<int> s_in_handler{0};
+        static inline std::atomic<int> s_next_slot{0};
+        static inline std::atomic<int> s_slots{0};
+        static inline uintptr_t s_pcs[g_max_threads] = {};
+
+        bool m_stopped;
+
+    public:
+        /********************************************************************
+            @brief Suspend all other threads, making sure none of them is
+                interrupted inside [address + 1, address + size).
+                If a thread can't be parked in time, the world is not stopped,
+                and stopped() returns false.
+
+            @param address [IN] The start of the code about to be patched
+            @param size [IN] The size of the code about to be patched
+        ********************************************************************/
+        CStopTheWorld(const void* address, size_t size)
+                : CStopTheWorld(std::vector<CodeRange>(1, CodeRange((uintptr_t) address, size))) {}
+
+        /********************************************************************
+            @brief Suspend all other threads, making sure none of them is
+                interrupted inside any of the given ranges (excluding
+                their first byte).
+
+            @param ranges [IN] The start and size of each patch
+        ********************************************************************/
+        explicit CStopTheWorld(const std::vector<CodeRange>& ranges) : m_stopped(false) {
+            InstallHandler();
+            for (int attempt = 0; attempt < g_max_attempts; ++attempt) {
+                int parked = Park(GetOtherThreads());
+                if (parked < 0) {
+                    Release();
+                    return;
+                }
+                bool inside = false;
+                for (int i = 0; (i < parked) && (i < g_max_threads); ++i) {
+                    for (const CodeRange& range : ranges) {
+                        inside = inside || ((s_pcs[i] > range.first) && (s_pcs[i] < range.first + range.second));
+                    }
+                }
+                if (!inside) {
+                    m_stopped = true;
+                    return;
+                }
+                Release();
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+
+        ~CStopTheWorld() {
+            if (m_stopped) {
+                Release();
+            }
+        }
+
+        bool stopped() const { return m_stopped; }
+
+    private:
+        static void InstallHandler() {
+            static bool installed = false;
+            if (installed) {
+                return;
+            }
+            struct sigaction action = {};
+            action.sa_sigaction = Handler;
+            action.sa_flags = SA_SIGINFO | SA_RESTART;
+            sigfillset(&action.sa_mask);
+            sigaction(CUTIE_STOP_THE_WORLD_SIGNAL, &action, nullptr);
+            installed = true;
+        }
+
+        static std::vector<pid_t> GetOtherThreads() {
+            std::vector<pid_t> threads;
+            pid_t self = (pid_t) syscall(SYS_gettid);
+            DIR* tasks = opendir("/proc/self/task");
+            if (nullptr == tasks) {
+                return threads;
+            }
+            while (struct dirent* entry = readdir(tasks)) {
+                pid_t tid = (pid_t) atoi(entry->d_name);
+                if ((tid > 0) && (tid != self)) {
+                    threads.push_back(tid);
+                }
+            }
+            closedir(tasks);
+            return threads;
+        }
+
+        // Returns the number of parked threads, or -1 if they couldn't all be parked in time
+        static int Park(const std::vector<pid_t>& threads) {
+            s_slots.store(g_max_threads);
+            s_next_slot.store(0);
+            s_parked.store(0);
+            s_released.store(0);
+
+            int signalled = 0;
+            for (pid_t tid : threads) {
+                // A thread may have exited since it was listed
+                if (0 == syscall(SYS_tgkill, getpid(), tid, CUTIE_STOP_THE_WORLD_SIGNAL)) {
+                    ++signalled;
+                }
+            }
+
+            auto deadline = std::chrono::steady_clock::now() + g_park_timeout;
+            while (s_parked.load(std::memory_order_acquire) < signalled) {
+                if (std::chrono::steady_clock::now() > deadline) {
+                    return -1;
+                }
+                sched_yield();
+            }
+            return signalled;
+        }
+
+        static void Release() {
+            // A late handler from a timed out stop mustn't record anything
+            s_slots.store(0);
+            s_released.store(1, std::memory_order_release);
+            syscall(SYS_futex, (int*) &s_released, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+            while (s_in_handler.load(std::memory_order_acquire) > 0) {
+                sched_yield();
+            }
+        }
+
+        static uintptr_t GetPc(void* context) {
+            ucontext_t* ucontext = (ucontext_t*) context;
+#if defined __x86_64__
+            return (uintptr_t) ucontext->uc_mcontext.gregs[REG_RIP];
+#elif defined __i386__
+            return (uintptr_t) ucontext->uc_mcontext.gregs[REG_EIP];
+#elif defined __aarch64__
+            return (uintptr_t) ucontext->uc_mcontext.pc;
+#else
+            return 0;
+#endif
+        }
+
+        static void Handler(int, siginfo_t*, void* context) {
+            int saved_errno = errno;
+            s_in_handler.fetch_add(1, std::memory_order_acq_rel);
+            int slot = s_next_slot.fetch_add(1, std::memory_order_relaxed);
+            if (slot < s_slots.load(std::memory_order_relaxed)) {
+                s_pcs[slot] = GetPc(context);
+            }
+            s_parked.fetch_add(1, std::memory_order_release);
+            // Sleep rather than spin, so parked threads don't compete with the patching thread
+            while (0 == s_released.load(std::memory_order_acquire)) {
+                syscall(SYS_futex, (int*) &s_released, FUTEX_WAIT_PRIVATE, 0, nullptr, nullptr, 0);
+            }
+            s_in_handler.fetch_sub(1, std::memory_order_acq_rel);
+            errno = saved_errno;
+        }
+
+        CStopTheWorld(const CStopTheWorld&) = delete;
+        CStopTheWorld& operator=(const CStopTheWorld&) = delete;
+    };
+
+}
+
+#endif //CUTIE_STOP_THE_WORLD_HPP
@@ -0,0 +1,252 @@
+/********************************************************************
+	File name:	subhook_arm64.hpp
+	Project  :	Cutie
+	Author   :	Dor Cohen
+
+    An AArch64 implementation of the part of Subhook's C interface that
+    Cutie uses, since Subhook supports only x86 and x86-64.
+    Cutie writes the jumps itself (see code_patch.hpp), so a hook here
+    is only a trampoline: the first instructions of the function,
+    relocated to a new page, followed by a jump back to the rest of it.
+    Instructions addressing memory relative to the PC (branches, ADR,
+    ADRP and literal loads) are rewritten to use absolute addresses.
+    A prologue with a SIMD literal load can't be relocated, and the hook
+    has no trampoline, as with Subhook (see HAS_ORIGINAL).
+    The trampoline is written before its page is made executable, so it
+    never needs a page that is writable and executable at once.
+
+********************************************************************/
+#ifndef CUTIE_SUBHOOK_ARM64_HPP
+#define CUTIE_SUBHOOK_ARM64_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define SUBHOOK_ARM64
+
+typedef enum subhook_flags { SUBHOOK_64BIT_OFFSET = 1, SUBHOOK_TRAMPOLINE = 1 << 1 } subhook_flags_t;
+
+struct subhook_struct {
+    void* src;
+    void* dst;
+    void* trampoline;
+    size_t trampoline_size;
+};
+
+typedef struct subhook_struct* subhook_t;
+
+namespace cutie {
+namespace arm64 {
+
+    // The prologue replaced by Cutie's jump: LDR X16, #8; BR X16; followed by the destination
+    static constexpr size_t g_prologue_size = 4;
+    // The longest relocation of a single instruction, in instructions
+    static constexpr size_t g_max_relocation_size = 6;
+
+    static constexpr uint32_t g_br_x16 = 0xD61F0200;
+    static constexpr uint32_t g_blr_x16 = 0xD63F0200;
+    static constexpr uint32_t g_nop = 0xD503201F;
+
+    inline int64_t SignExtend(uint64_t value, unsigned bits) {
+        uint64_t sign = (uint64_t) 1 << (bits - 1);
+        return (int64_t) ((value ^ sign) - sign);
+    }
+
+    // B #offset, in instructions
+    inline uint32_t Branch(int32_t offset) {
+        return 0x14000000 | ((uint32_t) offset & 0x03FFFFFF);
+    }
+
+    // LDR Xt, #offset, in instructions
+    inline uint32_t LoadLiteral(unsigned reg, uint32_t offset) {
+        return 0x58000000 | (offset << 5) | reg;
+    }
+
+    /********************************************************************
+        Writes instructions into a trampoline being built.
+    ********************************************************************/
+    class CCodeWriter {
+    private:
+        uint32_t* m_code;
+        size_t m_size;
+
+    public:
+        explicit CCodeWriter(uint32_t* code) : m_code(code), m_size(0) {}
+
+        size_t size() const { return m_size; }
+
+        void Emit(uint32_t instruction) {
+            m_code[m_size++] = instruction;
+        }
+
+        void EmitAddress(uint64_t address) {
+            std::memcpy(&m_code[m_size], &address, sizeof(address));
+            m_size += 2;
+        }
+
+        // LDR X16, #8; BR X16; followed by the destination
+        void EmitJump(uint64_t destination) {
+            Emit(LoadLiteral(16, 2));
+            Emit(g_br_x16);
+            EmitAddress(destination);
+        }
+
+        // LDR X16, #12; BLR X16; B #12; followed by the destination, so the call returns past it
+        void EmitCall(uint64_t destination) {
+            Emit(LoadLiteral(16, 3));
+            Emit(g_blr_x16);
+            Emit(Branch(3));
+            EmitAddress(destination);
+        }
+
+        // Loads an absolute address into a register: LDR Xt, #8; B #12; followed by the address
+        void EmitLoadAddress(unsigned reg, uint64_t address) {
+            Emit(LoadLiteral(reg, 2));
+            Emit(Branch(3));
+            EmitAddress(address);
+        }
+    };
+
+    /********************************************************************
+        @brief Relocate a single instruction to the trampoline.
+
+        @param writer [IN] The trampoline being built
+        @param instruction [IN] The instruction to relocate
+        @param pc [IN] The original address of the instruction
+        @return false if the instruction can't be relocated
+    ********************************************************************/
+    inline bool Relocate(CCodeWriter& writer, uint32_t instruction, uint64_t pc) {
+        // B, BL
+        if (0x14000000 == (instruction & 0x7C000000)) {
+            uint64_t target = pc + (SignExtend(instruction & 0x03FFFFFF, 26) << 2);
+            if (0 != (instruction & 0x80000000)) {
+                writer.EmitCall(target);
+            } else {
+                writer.EmitJump(target);
+            }
+            return true;
+        }
+        // B.cond, CBZ, CBNZ, TBZ and TBNZ branch over a jump to the next instruction, or to the jump to the target
+        bool is_conditional_branch = (0x54000000 == (instruction & 0xFF000010));
+        bool is_compare_branch = (0x34000000 == (instruction & 0x7E000000));
+        bool is_test_branch = (0x36000000 == (instruction & 0x7E000000));
+        if (is_conditional_branch || is_compare_branch) {
+            uint64_t target = pc + (SignExtend((instruction >> 5) & 0x7FFFF, 19) << 2);
+            writer.Emit((instruction & ~(0x7FFFFu << 5)) | (2u << 5));
+            writer.Emit(Branch(5));
+            writer.EmitJump(target);
+            return true;
+        }
+        if (is_test_branch) {
+            uint64_t target = pc + (SignExtend((instruction >> 5) & 0x3FFF, 14) << 2);
+            writer.Emit((instruction & ~(0x3FFFu << 5)) | (2u << 5));
+            writer.Emit(Branch(5));
+            writer.EmitJump(target);
+            return true;
+        }
+        // ADR, ADRP
+        if (0x10000000 == (instruction & 0x1F000000)) {
+            uint64_t offset = (((instruction >> 5) & 0x7FFFF) << 2) | ((instruction >> 29) & 0x3);
+            uint64_t address = pc + SignExtend(offset, 21);
+            if (0 != (instruction & 0x80000000)) {
+                address = (pc & ~(uint64_t) 0xFFF) + (SignExtend(offset, 21) << 12);
+            }
+            writer.EmitLoadAddress(instruction & 0x1F, address);
+            return true;
+        }
+        // LDR (literal), LDRSW (literal) and PRFM (literal) load from the address, through the target register
+        if (0x18000000 == (instruction & 0x3B000000)) {
+            bool is_simd = (0 != (instruction & 0x04000000));
+            unsigned opc = instruction >> 30;
+            unsigned reg = instruction & 0x1F;
+            uint64_t address = pc + (SignExtend((instruction >> 5) & 0x7FFFF, 19) << 2);
+            if (is_simd) {
+                return false;
+            }
+            if (3 == opc) {
+                writer.Emit(g_nop);
+                return true;
+            }
+            static const uint32_t loads[] = {0xB9400000, 0xF9400000, 0xB9800000};
+            writer.EmitLoadAddress(reg, address);
+            writer.Emit(loads[opc] | (reg << 5) | reg);
+            return true;
+        }
+        writer.Emit(instruction);
+        return true;
+    }
+
+    /********************************************************************
+        @brief Build the trampoline of a function.
+
+        @param src [IN] The function
+        @param size [OUT] The size of the mapping holding the trampoline
+        @return The trampoline, or nullptr if it can't be built
+    ********************************************************************/
+    inline void* BuildTrampoline(void* src, size_t* size) {
+        size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+        void* page = mmap(nullptr, page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (MAP_FAILED == page) {
+            return nullptr;
+        }
+        static_assert((g_prologue_size * g_max_relocation_size + 4) * 4 <= 4096, "The trampoline must fit in a page");
+        CCodeWriter writer((uint32_t*) page);
+        const uint32_t* prologue = (const uint32_t*) src;
+        for (size_t i = 0; i < g_prologue_size; ++i) {
+            if (!Relocate(writer, prologue[i], (uint64_t) (uintptr_t) &prologue[i])) {
+                munmap(page, page_size);
+                return nullptr;
+            }
+        }
+        writer.EmitJump((uint64_t) (uintptr_t) &prologue[g_prologue_size]);
+
+        if (0 != mprotect(page, page_size, PROT_READ | PROT_EXEC)) {
+            munmap(page, page_size);
+            return nullptr;
+        }
+        __builtin___clear_cache((char*) page, (char*) page + writer.size() * sizeof(uint32_t));
+        *size = page_size;
+        return page;
+    }
+
+}
+}
+
+/********************************************************************
+    @brief Create a hook on a function. Only builds its trampoline
+        (with SUBHOOK_TRAMPOLINE), as Cutie writes the jumps itself.
+********************************************************************/
+inline subhook_t subhook_new(void* src, void* dst, subhook_flags_t flags) {
+    subhook_t hook = new subhook_struct{src, dst, nullptr, 0};
+    if (0 != (flags & SUBHOOK_TRAMPOLINE)) {
+        hook->trampoline = cutie::arm64::BuildTrampoline(src, &hook->trampoline_size);
+    }
+    return hook;
+}
+
+inline void subhook_free(subhook_t hook) {
+    if (nullptr == hook) {
+        return;
+    }
+    if (nullptr != hook->trampoline) {
+        munmap(hook->trampoline, hook->trampoline_size);
+    }
+    delete hook;
+}
+
+inline void* subhook_get_src(subhook_t hook) {
+    return (nullptr == hook) ? nullptr : hook->src;
+}
+
+inline void* subhook_get_dst(subhook_t hook) {
+    return (nullptr == hook) ? nullptr : hook->dst;
+}
+
+inline void* subhook_get_trampoline(subhook_t hook) {
+    return (nullptr == hook) ? nullptr : hook->trampoline;
+}
+
+#endif //CUTIE_SUBHOOK_ARM64_HPP
@@ -0,0 +1,100 @@
+/********************************************************************
+	File name:	test_resources.hpp
+	Project  :	Cutie
+	Author   :	Dor Cohen
+
+    The resources used by each test: wall time, CPU time and the peak
+    memory (RSS) of the process.
+    When the CUTIE_TEST_RESULTS environment variable names a file (as
+    the `all_tests` target sets it), a GoogleTest listener appends a
+    line of JSON per test to it:
+        {"executable": "my_test", "test": "Suite.Test", "passed": true,
+         "wall_us": 1200, "cpu_us": 1000, "peak_rss_kb": 5400}
+    Each line is appended with a single write(), so tests running in
+    parallel (or in the children of the fork server) may share the
+    file. The lines are compared to a baseline by TestTimes.cmake.
+    The listener is registered by every test executable including
+    mock.hpp. A test using only hook.hpp should include this file too.
+
+********************************************************************/
+#ifndef CUTIE_TEST_RESOURCES_HPP
+#define CUTIE_TEST_RESOURCES_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <gtest/gtest.h>
+
+namespace cutie {
+
+    class CTestResourcesListener : public ::testing::EmptyTestEventListener {
+    private:
+        std::string m_path;
+        std::chrono::steady_clock::time_point m_start;
+        std::chrono::microseconds m_cpu_at_start;
+
+    public:
+        explicit CTestResourcesListener(const std::string& path) : m_path(path), m_start(), m_cpu_at_start(0) {}
+
+        // Appends a listener to GoogleTest's listeners, which owns it, if CUTIE_TEST_RESULTS is set
+        static bool Register() {
+            const char* path = std::getenv("CUTIE_TEST_RESULTS");
+            if (nullptr == path || '\0' == path[0]) {
+                return false;
+            }
+            ::testing::UnitTest::GetInstance()->listeners().Append(new CTestResourcesListener(path));
+            return true;
+        }
+
+        void OnTestStart(const ::testing::TestInfo&) override {
+            m_cpu_at_start = CpuTime();
+            m_start = std::chrono::steady_clock::now();
+        }
+
+        void OnTestEnd(const ::testing::TestInfo& test_info) override {
+            std::chrono::steady_clock::duration wall = std::chrono::steady_clock::now() - m_start;
+            std::chrono::microseconds cpu = CpuTime() - m_cpu_at_start;
+            struct rusage usage{};
+            getrusage(RUSAGE_SELF, &usage);
+
+            std::ostringstream line;
+            line << "{\"executable\": \"" << program_invocation_short_name << "\", \"test\": \""
+                 << test_info.test_suite_name() << "." << test_info.name() << "\", \"passed\": "
+                 << (test_info.result()->Passed() ? "true" : "false") << ", \"wall_us\": "
+                 << std::chrono::duration_cast<std::chrono::microseconds>(wall).count() << ", \"cpu_us\": "
+                 << cpu.count() << ", \"peak_rss_kb\": " << usage.ru_maxrss << "}\n";
+            Append(line.str());
+        }
+
+    private:
+        // The CPU time of all threads of the process, in user and kernel mode
+        static std::chrono::microseconds CpuTime() {
+            struct rusage usage{};
+            getrusage(RUSAGE_SELF, &usage);
+            return std::chrono::seconds(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+                   std::chrono::microseconds(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+        }
+
+        void Append(const std::string& line) const {
+            int fd = open(m_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (-1 == fd) {
+                return;
+            }
+            if (write(fd, line.data(), line.size()) != (ssize_t) line.size()) {
+                // A partial line is skipped by the comparison
+            }
+            close(fd);
+        }
+    };
+
+    inline const bool g_test_resources_listener = CTestResourcesListener::Register();
+
+}
+
+#endif //CUTIE_TEST_RESOURCES_HPP
@@ -0,0 +1,120 @@
+/********************************************************************
+	File name:	thread_dispatch.hpp
+	Project  :	Cutie
+	Author   :	Dor Cohen
+
+    Per-thread hooks.
+    The function is redirected once to a dispatcher, that calls the stub
+    installed by the calling thread, or the original function (through
+    its trampoline) if the thread didn't install one. Thus several
+    threads can stub the same function differently at the same time,
+    and calling the original function never removes the hook.
+    Only used internally by DECLARE_THREAD_HOOKABLE and INSTALL_THREAD_HOOK.
+
+********************************************************************/
+#ifndef CUTIE_THREAD_DISPATCH_HPP
+#define CUTIE_THREAD_DISPATCH_HPP
+
+#include <mutex>
+#include <stdexcept>
+#include "c_scoped_hook.hpp"
+#include "function_traits.hpp"
+
+namespace cutie {
+
+    template<typename Tag, typename Signature>
+    class CThreadDispatcher;
+
+    /********************************************************************
+        Tag - A type unique to the hooked function
+    ********************************************************************/
+    template<typename Tag, typename R, typename... Args>
+    class CThreadDispatcher<Tag, R(Args...)> {
+    public:
+        typedef R (* Function)(Args...);
+
+    private:
+        static inline thread_local Function t_stub = nullptr;
+
+        static inline std::mutex s_mutex;
+        static inline size_t s_users = 0;
+        static inline CHookSite* s_site = nullptr;
+        static inline subhook_t s_hook = nullptr;
+        static inline void* s_previous_dst = nullptr;
+        static inline Function s_original = nullptr;
+
+    public:
+        // The original function, callable from any thread regardless of installed stubs
+        static Function original() {
+            return (nullptr != s_original) ? s_original : CallRemoved;
+        }
+
+        /********************************************************************
+            Installs a stub for the current thread only.
+            The dispatcher is installed while at least one thread has a stub.
+        ********************************************************************/
+        class CScopedInstall {
+        private:
+            Function m_previous_stub;
+
+        public:
+            CScopedInstall(void* func, void* stub)
+                    : m_previous_stub(t_stub) {
+                Acquire(func);
+                t_stub = (Function) stub;
+            }
+
+            void Replace(void* stub) {
+                t_stub = (Function) stub;
+            }
+
+            ~CScopedInstall() {
+                t_stub = m_previous_stub;
+                Release();
+            }
+
+        private:
+            CScopedInstall(const CScopedInstall&) = delete;
+            CScopedInstall& operator=(const CScopedInstall&) = delete;
+        };
+
+    private:
+        static R Dispatch(Args... args) {
+            Function stub = t_stub;
+            if (nullptr != stub) {
+                return stub(args...);
+            }
+            return original()(args...);
+        }
+
+        // Used if Subhook couldn't build a trampoline for the function. Not thread-safe.
+        static R CallRemoved(Args... args) {
+            CScopedHookRemove remove(&s_hook);
+            return ((Function) s_site->src())(args...);
+        }
+
+        static void Acquire(void* func) {
+            std::lock_guard<std::mutex> lock(s_mutex);
+            if (0 == s_users++) {
+                s_site = &CHookRegistry::Instance().Acquire(func);
+                s_hook = s_site->handle();
+                s_original = (Function) s_site->trampoline();
+                s_previous_dst = s_site->dst();
+                if (!s_site->Patch((void*) Dispatch)) {
+                    --s_users;
+                    throw std::runtime_error("Can't install the dispatcher, the function's code can't be patched");
+                }
+            }
+        }
+
+        static void Release() {
+            std::lock_guard<std::mutex> lock(s_mutex);
+            if (0 == --s_users) {
+                s_site->Patch(s_previous_dst);
+            }
+        }
+    };
+
+}
+
+#endif //CUTIE_THREAD_DISPATCH_HPP
@@ -0,0 +1,119 @@
+/********************************************************************
+	File name:	variadic_mocker.hpp
+	Project  :	Cutie
+	Author   :	Dor Cohen
+
+    Mocking C functions with ellipsis, such as printf().
+    GMock can't declare a mock method with ellipsis, so the mock takes
+    the fixed parameters and a va_list instead, like the function's
+    v* counterpart (vprintf() for printf()). The stub installed in place
+    of the function collects the extra arguments into the va_list, and
+    calls the mock. By default, the mock calls the v* counterpart,
+    which runs the original code without removing the hook.
+    Only used internally by DECLARE_MOCKABLE_VARIADIC.
+
+********************************************************************/
+#ifndef CUTIE_VARIADIC_MOCKER_HPP
+#define CUTIE_VARIADIC_MOCKER_HPP
+
+#include <cstdarg>
+#include <type_traits>
+#include <gmock/gmock.h>
+
+namespace cutie {
+
+    template<typename Signature>
+    struct CVariadicStub;
+
+    /********************************************************************
+        Generates the stub installed in place of a function with ellipsis,
+        which forwards its fixed arguments and a va_list of the rest.
+        The last fixed parameter must be named for va_start, so there's a
+        specialization per number of fixed parameters, up to 4.
+    ********************************************************************/
+    template<typename R, typename A1>
+    struct CVariadicStub<R(A1, ...)> {
+        template<R (* Forward)(A1, va_list)>
+        static R Call(A1 a1, ...) {
+            va_list args;
+            va_start(args, a1);
+            if constexpr (std::is_void_v<R>) {
+                Forward(a1, args);
+                va_end(args);
+            } else {
+                R result = Forward(a1, args);
+                va_end(args);
+                return result;
+            }
+        }
+    };
+
+    template<typename R, typename A1, typename A2>
+    struct CVariadicStub<R(A1, A2, ...)> {
+        template<R (* Forward)(A1, A2, va_list)>
+        static R Call(A1 a1, A2 a2, ...) {
+            va_list args;
+            va_start(args, a2);
+            if constexpr (std::is_void_v<R>) {
+                Forward(a1, a2, args);
+                va_end(args);
+            } else {
+                R result = Forward(a1, a2, args);
+                va_end(args);
+                return result;
+            }
+        }
+    };
+
+    template<typename R, typename A1, typename A2, typename A3>
+    struct CVariadicStub<R(A1, A2, A3, ...)> {
+        template<R (* Forward)(A1, A2, A3, va_list)>
+        static R Call(A1 a1, A2 a2, A3 a3, ...) {
+            va_list args;
+            va_start(args, a3);
+            if constexpr (std::is_void_v<R>) {
+                Forward(a1, a2, a3, args);
+                va_end(args);
+            } else {
+                R result = Forward(a1, a2, a3, args);
+                va_end(args);
+                return result;
+            }
+        }
+    };
+
+    template<typename R, typename A1, typename A2, typename A3, typename A4>
+    struct CVariadicStub<R(A1, A2, A3, A4, ...)> {
+        template<R (* Forward)(A1, A2, A3, A4, va_list)>
+        static R Call(A1 a1, A2 a2, A3 a3, A4 a4, ...) {
+            va_list args;
+            va_start(args, a4);
+            if constexpr (std::is_void_v<R>) {
+                Forward(a1, a2, a3, a4, args);
+                va_end(args);
+            } else {
+                R result = Forward(a1, a2, a3, a4, args);
+                va_end(args);
+                return result;
+            }
+        }
+    };
+
+    /********************************************************************
+        @brief Make a mock call a function by default, for any arguments.
+            Expectations and default behaviors set by the test take
+            precedence.
+
+        @param mock [IN] The mock, taking the fixed parameters and a va_list
+        @param forwarder [IN] The v* counterpart of the mocked function
+    ********************************************************************/
+    template<typename R, typename... Args>
+    void ForwardByDefault(::testing::MockFunction<R(Args...)>& mock, R (* forwarder)(Args...)) {
+        mock.gmock_Call(::testing::A<Args>()...)
+                .InternalDefaultActionSetAt(__FILE__, __LINE__, "mock", "Call")
+                .WillByDefault(::testing::Invoke(forwarder));
+    }
+
+}
+
+#endif //CUTIE_VARIADIC_MOCKER_HPP
@@ -55,6 +55,8 @@
 		* The `using` statement is for GMock's constructs.
 		* DECLARE_MOCKABLE is used to declare fopen() and fclose() as mockable functions.
 		  When declaring, you need to specify how many parameters each function has.
+		  Alternatively, DECLARE_AUTO_MOCKABLE(fopen) deduces the parameters from fopen()'s declaration.
+		  It is also lighter to compile, which adds up in test files that declare many mocks.
 		* INSTALL_EXPECT_CALL() and CUTIE_EXPECT_CALL() are equivalent to GMock's EXPECT_CALL().
 		  After using it you can use all constructs available with EXPECT_CALL.
 		  In our example, we mock fopen() with any parameters received, and
@@ -126,6 +128,13 @@
 		  expectation inside the loop, like this:
 		  	CUTIE_EXPECT_CALL(...).WillOnce(...).RetiresOnSaturation();
 
+	Each CUTIE_EXPECT_CALL() is a separate expectation, allocated on its own, and GMock checks all of them on every
+	call. For many calls returning a sequence of values, set a single expectation with CUTIE_EXPECT_SEQUENCE instead,
+	which keeps the values in one array:
+
+		std::vector<int> results(100000, 0);
+		CUTIE_EXPECT_SEQUENCE(fclose, results, _);	// Expects 100000 calls, returning each of the results in order
+
 	Breaking up INSTALL_HOOK
  	~~~~~~~~~~~~~~~~~~~~~~~~
  	The INSTALL_HOOK macro creates and initialized a Mock Container (an internal implementation class that allows
@@ -145,33 +154,259 @@
  	    
  	This is pretty useful if you want to declare the Mock Container as a class field, and initialize it in a function
  	or in the constructor.
+
+ 	Lazy mocks
+ 	~~~~~~~~~~
+ 	Fixtures often install many mocks "just in case", even though most tests set behavior on only a few of them.
+ 	INSTALL_LAZY_MOCK declares the container without patching the function. The function is patched on the first
+ 	CUTIE_EXPECT_CALL or CUTIE_ON_CALL, or by CUTIE_ARM_MOCK:
+
+ 	    INSTALL_LAZY_MOCK(fopen);
+ 	    INSTALL_LAZY_MOCK(fclose);
+ 	    CUTIE_EXPECT_CALL(fopen, _, _).WillOnce(Return(nullptr));  // Only fopen() is patched
+
+ 	Note that, unlike INSTALL_MOCK, a lazy mock that was never armed doesn't return default values -
+ 	the original function is called. Use CUTIE_ARM_MOCK to get INSTALL_MOCK's behavior.
+
+ 	Sharing containers between tests
+ 	~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ 	INSTALL_MOCK builds a new container (a GMock object and a hook) in every test.
+ 	In large suites, the container can be built once and shared by all tests in the binary,
+ 	using CUTIE_SUITE_CONTAINER as a member of the test fixture:
+
+ 	    class MyModuleTest : public ::testing::Test {
+ 	    protected:
+ 	        CUTIE_SUITE_CONTAINER(fopen);
+ 	        CUTIE_SUITE_CONTAINER(fclose);
+ 	    };
+
+ 	    TEST_F(MyModuleTest, fopen_fails) {
+ 	        CUTIE_EXPECT_CALL(fopen, _, _).WillOnce(Return(nullptr));
+ 	        EXPECT_EQ(MYMODULE_calculate(), -1);
+ 	    }
+
+ 	The shared container is installed when each test starts. When the test ends, its expectations are verified,
+ 	its expectations and default behaviors are cleared (using Mock::VerifyAndClear), and it is
+ 	uninstalled until the next test starts, so GoogleTest's own output between tests isn't mocked.
+ 	Default behaviors set with CUTIE_ON_CALL must therefore be set in every test (or in SetUp()).
+ 	Don't mix CUTIE_SUITE_CONTAINER and INSTALL_MOCK on the same function.
+
+ 	Installing many mocks at once
+ 	~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ 	Mocks can be installed in a single batch together with hooks, using a hook set (see hook.hpp).
+ 	Declare the containers uninitialized, before the set, so they outlive it:
+
+ 	    CUTIE_UNINITIALIZED_CONTAINER(fopen);
+ 	    CUTIE_UNINITIALIZED_CONTAINER(fclose);
+ 	    DECLARE_HOOK_SET(hooks);
+ 	    HOOK_SET_ADD_MOCK(hooks, fopen);
+ 	    HOOK_SET_ADD_MOCK(hooks, fclose);
+ 	    HOOK_SET_INSTALL(hooks);
+ 	    CUTIE_EXPECT_CALL(fopen, _, _).WillOnce(Return(nullptr));
  
+ 	Timing mocked calls
+ 	~~~~~~~~~~~~~~~~~~~
+ 	Every call to an installed mock is timestamped with a monotonic clock, which lets a test check how fast the code
+ 	under test is, not only what it calls:
+
+ 	    using namespace std::chrono_literals;
+
+ 	    TEST(MYMODULE, writes_right_after_opening) {
+ 	        INSTALL_MOCK(fopen);
+ 	        INSTALL_MOCK(fwrite);
+ 	        CUTIE_START_STOPWATCH(stopwatch);
+ 	        MYMODULE_calculate();
+ 	        EXPECT_SHORTER_THAN(stopwatch.elapsed_excluding_mocks(), 1ms);
+ 	        EXPECT_MOCK_CALL_WITHIN(fwrite, 2, MOCK_CALL_TIME(fopen, 0), 50us);  // The 3rd fwrite()
+ 	    }
+
+ 	elapsed_excluding_mocks() leaves out the time the calling thread spent inside mocks, including their actions.
+ 	Calls are recorded by the latest container of each function, in the order they started.
+
+ 	Recording and replaying
+ 	~~~~~~~~~~~~~~~~~~~~~~~
+ 	Setting expectations for thousands of calls (say, the read() and write() calls of a protocol session) is
+ 	unworkable. Instead, record the calls once, against the real dependency, and replay them in later runs:
+
+ 	    DECLARE_AUTO_MOCKABLE(read);
+ 	    DECLARE_AUTO_MOCKABLE(write);
+
+ 	    TEST(MYPROTOCOL, handshake) {
+ 	        INSTALL_MOCK(read);
+ 	        INSTALL_MOCK(write);
+ 	        CUTIE_RECORD_OR_REPLAY(read, "captures/handshake.read",
+ 	                cutie::UncheckedArgument(0), cutie::OutputBuffer(1, 2));
+ 	        CUTIE_RECORD_OR_REPLAY(write, "captures/handshake.write",
+ 	                cutie::UncheckedArgument(0), cutie::InputBuffer(1, 2));
+ 	        EXPECT_EQ(MYPROTOCOL_handshake(server_fd), 0);
+ 	    }
+
+ 	CUTIE_RECORD makes the mock call the original function, and log every call into a compact binary file: the
+ 	arguments, the result and errno. CUTIE_REPLAY makes the mock return the logged results (and set errno) in the same
+ 	order, without calling the original function, and fails the test if the arguments differ from the recorded ones,
+ 	or if the number of calls does. CUTIE_RECORD_OR_REPLAY records if the CUTIE_RECORD environment variable is set,
+ 	and replays otherwise, so the captures are refreshed with `CUTIE_RECORD=1 ./test`.
+
+ 	Arguments are logged by value, and pointer arguments by whether they're null. List the buffers to log when
+ 	recording (the log remembers them for replaying):
+ 	    * cutie::InputBuffer(argument, size_argument) logs what a pointer points to before the call, and checks it
+ 	      on replay. For example, the data write() writes.
+ 	    * cutie::OutputBuffer(argument, size_argument) logs what the function wrote to a pointer, and writes it on
+ 	      replay. For example, the data read() read: as many bytes as the result, if it's a byte count.
+ 	      Without a size argument, the whole pointed type is logged, for example stat()'s struct.
+ 	    * cutie::UncheckedArgument(argument) logs an argument, but doesn't check it on replay, for arguments that
+ 	      differ between runs, such as file descriptors.
+ 	Arguments are numbered from 0. A pointer result is replayed as the recorded address, so it's only good as a
+ 	handle passed to other replayed functions.
+ 	The recording or replay is the mock's default behavior, so expectations can still be set on top of it.
+ 	Logs are in the machine's byte order, and are meant to be replayed on the architecture that recorded them.
+
  	Ellipsis
 	~~~~~~~~
-	CMock doesn't support mocking functions with ellipsis.
-	It may be possible if the number of arguments is known, but is not tested.
+	GMock can't mock functions with ellipsis, such as printf(), directly. DECLARE_MOCKABLE_VARIADIC mocks them with the
+	fixed parameters and a va_list of the rest, given the function's v* counterpart, which takes the same:
+
+	    DECLARE_MOCKABLE_VARIADIC(sprintf, 2, vsprintf);
+
+	    TEST(MYMODULE, formats_the_path) {
+	        INSTALL_MOCK(sprintf);
+	        CUTIE_EXPECT_CALL(sprintf, _, StrEq("%s/%s"), _);   // The last matcher is of the va_list
+	        MYMODULE_calculate();
+	    }
+
+	By default, the mock calls the v* counterpart (vsprintf() above) with the same arguments, so the original code
+	runs without removing and reinstalling the hook on every call. Set expectations or default behaviors to replace it,
+	for example .WillOnce(Return(-1)). To look at the extra arguments, use an action that takes the va_list.
+	Up to 4 fixed parameters are supported.
+
+	Counting allocations
+	~~~~~~~~~~~~~~~~~~~~
+	Hooking malloc() with INSTALL_HOOK and SCOPE_REMOVE_HOOK is slow, and recurses
+	as soon as anything in between allocates. Cutie has a built-in allocation
+	tracker instead, which hooks malloc(), calloc(), realloc() and free() with stubs
+	that only bump atomic counters and call the originals through their trampolines:
+
+		TEST(MYMODULE, steady_state_doesnt_allocate) {
+			MYMODULE_init();
+			EXPECT_MAX_ALLOCATIONS(0);
+			for (int i = 0; i < 100; ++i) {
+				MYMODULE_process();
+			}
+		}
+
+	The budget is checked when the scope ends. EXPECT_MAX_BYTES limits the bytes
+	allocated instead. Several budgets may be set in the same scope, one per line.
+	To check the counts yourself, use CUTIE_TRACK_ALLOCATIONS:
+
+		CUTIE_TRACK_ALLOCATIONS(tracker);
+		MYMODULE_process();
+		EXPECT_LE(tracker.allocations(), 2);
+		EXPECT_LE(tracker.bytes(), 1024);
+
+	Allocations made by all threads are counted, including those of C++'s new,
+	which calls malloc(). The hooks are installed while any tracker exists, so
+	don't hook the allocation functions otherwise meanwhile.
+	Subhook can't build a trampoline for glibc's free(), so frees are counted
+	(by tracker.frees()) only where tracker.counts_frees() is true.
 
 ********************************************************************/
 #ifndef CUTIE_MOCK_HPP
 #define CUTIE_MOCK_HPP
 
 #include "inc/mock_container.hpp"
+#include "inc/auto_mocker.hpp"
+#include "inc/variadic_mocker.hpp"
+#include "inc/record_replay.hpp"
+#include "inc/return_sequence.hpp"
+#include "inc/fast_default.hpp"
+#include "inc/alloc_tracker.hpp"
+#include "inc/call_statistics_listener.hpp"
+#include "inc/test_resources.hpp"
 
 /********************************************************************
 	@brief Declare a function as mockable. Must be called once for
 		every function that will be mocked, or else mocking won't work.
+		The mock is local to the test file, so several test files linked
+		into the same executable may declare the same function. So is the
+		stub C-Mock's CMOCK_MOCK_FUNCTION defines, which is only called
+		through the hook, never by name.
 
 	@param func [IN] The function name to mark as mockable
 	@param num_params [IN] The number of parameters
 ********************************************************************/
 #define DECLARE_MOCKABLE(func, num_params) \
+    namespace { \
     class MockContainer_##func : public MockContainer<MockContainer_##func> { \
     public: \
         MockContainer_##func() : MockContainer<MockContainer_##func>((void*)(func), nullptr) {} \
         explicit MockContainer_##func(void* stub) : MockContainer<MockContainer_##func>((void*)(func), stub) {} \
+        static const char* name() { return #func; } \
         MOCK_METHOD##num_params(__CMOCK_STUB__##func, decltype(func)); \
     }; \
     CMOCK_MOCK_FUNCTION##num_params(MockContainer_##func, __CMOCK_STUB__##func, decltype(func)); \
+    constexpr auto __CUTIE_TIMED_STUB__##func = &cutie::CTimedStub<MockContainer_##func, \
+            cutie::Signature<decltype(func)> >::Call<__CMOCK_STUB__##func>; \
+    } \
+    static_assert(true, "Semicolon required")
+
+/********************************************************************
+	@brief Declare a function as mockable, deducing its parameters from its declaration.
+		Equivalent to DECLARE_MOCKABLE, but the number of parameters isn't
+		needed, and it's cheaper to compile. Like DECLARE_MOCKABLE, the mock
+		is local to the test file.
+
+	@param func [IN] The function name to mark as mockable
+********************************************************************/
+#define DECLARE_AUTO_MOCKABLE(func) \
+    namespace { \
+    class MockContainer_##func : public MockContainer<MockContainer_##func, \
+            cutie::CAutoMocker<MockContainer_##func, cutie::Signature<decltype(func)> > > { \
+    public: \
+        MockContainer_##func() : MockContainer((void*)(func), nullptr) {} \
+        explicit MockContainer_##func(void* stub) : MockContainer((void*)(func), stub) {} \
+        static const char* name() { return #func; } \
+        template<typename... Matchers> \
+        ::testing::MockSpec<cutie::Signature<decltype(func)> > gmock___CMOCK_STUB__##func(const Matchers&... matchers) { \
+            return this->gmock_Call(matchers...); \
+        } \
+    }; \
+    constexpr auto __CMOCK_STUB__##func = &MockContainer_##func::Stub; \
+    constexpr auto __CUTIE_TIMED_STUB__##func = &cutie::CTimedStub<MockContainer_##func, \
+            cutie::Signature<decltype(func)> >::Call<__CMOCK_STUB__##func>; \
+    } \
+    static_assert(true, "Semicolon required")
+
+/********************************************************************
+	@brief Declare a function with ellipsis as mockable.
+		The mock takes the fixed parameters and a va_list of the rest,
+		and calls va_forwarder with them by default. Like DECLARE_MOCKABLE,
+		the mock is local to the test file.
+
+	@param func [IN] The function name to mark as mockable
+	@param fixed_params [IN] The number of parameters before the ellipsis (up to 4)
+	@param va_forwarder [IN] The function taking the fixed parameters and a
+		va_list, such as vprintf for printf
+********************************************************************/
+#define DECLARE_MOCKABLE_VARIADIC(func, fixed_params, va_forwarder) \
+    namespace { \
+    static_assert(cutie::FunctionTraits<decltype(func)>::arity == (fixed_params), \
+            #func " has a different number of parameters before the ellipsis"); \
+    class MockContainer_##func : public MockContainer<MockContainer_##func, \
+            cutie::CAutoMocker<MockContainer_##func, cutie::Signature<decltype(va_forwarder)> > > { \
+    public: \
+        MockContainer_##func() : MockContainer((void*)(func), nullptr) { SetDefaultActions(); } \
+        explicit MockContainer_##func(void* stub) : MockContainer((void*)(func), stub) { SetDefaultActions(); } \
+        static const char* name() { return #func; } \
+        void SetDefaultActions() override { cutie::ForwardByDefault(*this, &va_forwarder); } \
+        template<typename... Matchers> \
+        ::testing::MockSpec<cutie::Signature<decltype(va_forwarder)> > gmock___CMOCK_STUB__##func(const Matchers&... matchers) { \
+            return this->gmock_Call(matchers...); \
+        } \
+    }; \
+    constexpr auto __CMOCK_STUB__##func = &MockContainer_##func::Stub; \
+    constexpr auto __CUTIE_TIMED_STUB__##func = &cutie::CVariadicStub<cutie::Signature<decltype(func)> >::Call< \
+            cutie::CTimedStub<MockContainer_##func, cutie::Signature<decltype(va_forwarder)> >::Call<__CMOCK_STUB__##func> >; \
+    } \
     static_assert(true, "Semicolon required")
 
 /********************************************************************
@@ -188,7 +423,20 @@
 
 	@param func [IN] The function name to mock
 ********************************************************************/
-#define CUTIE_INITIALIZE_CONTAINER(func) __cmock__##func.set_stub((void*)__CMOCK_STUB__##func)
+#define CUTIE_INITIALIZE_CONTAINER(func) __cmock__##func.set_stub((void*)__CUTIE_TIMED_STUB__##func)
+
+/********************************************************************
+	@brief Use a container shared by all tests in the binary.
+		Declare as a member of a test fixture (or inside a test).
+		The container is installed for the lifetime of the fixture,
+		and its expectations are verified and cleared when the test ends.
+
+	@param func [IN] The function name to mock
+********************************************************************/
+#define CUTIE_SUITE_CONTAINER(func) \
+    MockContainer_##func& __cmock__##func = cutie::CSuiteContainer<MockContainer_##func>::Instance(); \
+    cutie::CScopedSuiteContainerInstall<MockContainer_##func> __suite_install__##func{ \
+            __cmock__##func, (void*)__CUTIE_TIMED_STUB__##func}
 
 /********************************************************************
 	@brief Declare and initialize a mock, without setting expectations or default behavior on it.
@@ -197,7 +445,25 @@
 
 	@param func [IN] The function name to mock
 ********************************************************************/
-#define INSTALL_MOCK(func) CUTIE_UNINITIALIZED_CONTAINER(func)((void*)__CMOCK_STUB__##func)
+#define INSTALL_MOCK(func) CUTIE_UNINITIALIZED_CONTAINER(func)((void*)__CUTIE_TIMED_STUB__##func)
+
+/********************************************************************
+	@brief Declare a mock that's installed only once behavior is set on it,
+		by CUTIE_EXPECT_CALL, CUTIE_ON_CALL or CUTIE_ARM_MOCK.
+		If none of them is reached, the function is never patched.
+
+	@param func [IN] The function name to mock
+********************************************************************/
+#define INSTALL_LAZY_MOCK(func) CUTIE_UNINITIALIZED_CONTAINER(func); __cmock__##func.set_lazy_stub((void*)__CUTIE_TIMED_STUB__##func)
+
+/********************************************************************
+	@brief Install a mock declared with INSTALL_LAZY_MOCK, without setting
+		expectations or default behavior on it.
+		Does nothing if the mock is already installed.
+
+	@param func [IN] The function name to mock
+********************************************************************/
+#define CUTIE_ARM_MOCK(func) ((void) __cmock__##func.arm())
 
 /********************************************************************
 	@brief The equivalent of GMock's EXPECT_CALL.
@@ -211,7 +477,20 @@
 	@param func [IN] The function name to mock
 	@param ... [IN] The expected parameters of the function.
 ********************************************************************/
-#define CUTIE_EXPECT_CALL(func, ...) EXPECT_CALL(__cmock__##func, __CMOCK_STUB__##func(__VA_ARGS__))
+#define CUTIE_EXPECT_CALL(func, ...) EXPECT_CALL(__cmock__##func.expect(), __CMOCK_STUB__##func(__VA_ARGS__))
+
+/********************************************************************
+	@brief Expect a call per value of a sequence, returning the values
+		in order. Equivalent to a CUTIE_EXPECT_CALL().WillOnce() per
+		value, in an InSequence, but as a single expectation.
+		Use in conjunction with INSTALL_MOCK.
+
+	@param func [IN] The function name to mock
+	@param values [IN] The values to return, any range (such as a
+		std::vector or an array) convertible to the function's result
+	@param ... [IN] The expected parameters of the function, for all calls.
+********************************************************************/
+#define CUTIE_EXPECT_SEQUENCE(func, values, ...) cutie::ExpectSequence(CUTIE_EXPECT_CALL(func, __VA_ARGS__), (values))
 
 /********************************************************************
 	@brief The equivalent of GMock's EXPECT_CALL, to use without INSTALL_MOCK.
@@ -230,10 +509,20 @@
 				ON_CALL(myfunc(1, 2))
 				CUTIE_ON_CALL(myfunc, 1, 2)
 
+ 		   While the only behavior set on the mock is a single CUTIE_ON_CALL
+ 		   whose parameters are all "_", calls skip GMock, and perform the
+ 		   action directly. Setting an expectation goes back to GMock, until
+ 		   the container is verified and cleared.
+ 		   GMock doesn't know about that action, so verify and clear the
+ 		   mock with CUTIE_VERIFY_AND_CLEAR rather than Mock::VerifyAndClear,
+ 		   which would leave it performed.
+
 	@param func [IN] The function name to mock
 	@param ... [IN] The expected parameters of the function.
 ********************************************************************/
-#define CUTIE_ON_CALL(func, ...) ON_CALL(__cmock__##func, __CMOCK_STUB__##func(__VA_ARGS__))
+#define CUTIE_ON_CALL(func, ...) \
+    cutie::MakeDefaultSpec(__cmock__##func, ON_CALL(__cmock__##func.arm(), __CMOCK_STUB__##func(__VA_ARGS__)), \
+            cutie::AreWildcards(__VA_ARGS__))
 
 /********************************************************************
 	@brief The equivalent of GMock's ON_CALL, to use without INSTALL_MOCK.
@@ -243,4 +532,146 @@
 ********************************************************************/
 #define INSTALL_ON_CALL(func, ...) INSTALL_MOCK(func); CUTIE_ON_CALL(func, __VA_ARGS__)
 
-#endif // CUTIE_MOCK_HPP
\ No newline at end of file
+/********************************************************************
+	@brief The equivalent of GMock's Mock::VerifyAndClear, which also
+		clears the action CUTIE_ON_CALL performs without GMock.
+
+	@param func [IN] The mocked function
+	@return Whether the mock's expectations were satisfied
+********************************************************************/
+#define CUTIE_VERIFY_AND_CLEAR(func) (__cmock__##func.verify_and_clear())
+
+/********************************************************************
+	@brief Record the calls to an installed mock: call the original
+		function, and log the arguments, the result and errno.
+
+	@param func [IN] The mocked function
+	@param ... [IN] The log's path, which is replaced, then the buffers to log,
+		as cutie::InputBuffer() and cutie::OutputBuffer()
+********************************************************************/
+#define CUTIE_RECORD(func, ...) \
+    __CUTIE_RECORDING(func, cutie::CRecording<cutie::Signature<decltype(func)> >::Mode::Record, __VA_ARGS__)
+
+/********************************************************************
+	@brief Replay the calls to an installed mock from a log written
+		by CUTIE_RECORD, without calling the original function.
+
+	@param func [IN] The mocked function
+	@param ... [IN] The log's path, then optionally the buffers of
+		CUTIE_RECORD, which are ignored
+********************************************************************/
+#define CUTIE_REPLAY(func, ...) \
+    __CUTIE_RECORDING(func, cutie::CRecording<cutie::Signature<decltype(func)> >::Mode::Replay, __VA_ARGS__)
+
+/********************************************************************
+	@brief CUTIE_RECORD if the CUTIE_RECORD environment variable is
+		set, CUTIE_REPLAY otherwise.
+********************************************************************/
+#define CUTIE_RECORD_OR_REPLAY(func, ...) \
+    __CUTIE_RECORDING(func, cutie::CRecording<cutie::Signature<decltype(func)> >::ModeFromEnvironment(), __VA_ARGS__)
+
+/********************************************************************
+	@brief The number of calls recorded or replayed so far.
+
+	@param func [IN] The mocked function
+********************************************************************/
+#define RECORDED_CALL_COUNT(func) (__recording__##func.calls())
+
+#define __CUTIE_RECORDING(func, mode, ...) \
+    cutie::CRecording<cutie::Signature<decltype(func)> > __recording__##func(#func, (mode), (func), __cmock__##func, \
+            [&](const auto&... matchers) { return __cmock__##func.gmock___CMOCK_STUB__##func(matchers...); }, \
+            __VA_ARGS__)
+
+/********************************************************************
+	@brief Add a mock to a hook set declared with DECLARE_HOOK_SET.
+		The mock takes place on HOOK_SET_INSTALL.
+		The container must be declared with CUTIE_UNINITIALIZED_CONTAINER
+		before the set, and must not be initialized.
+
+	@param set [IN] The set declared with DECLARE_HOOK_SET
+	@param func [IN] The function name to mock
+********************************************************************/
+#define HOOK_SET_ADD_MOCK(set, func) ((set).Add((void*)(func), (void*)__CUTIE_TIMED_STUB__##func))
+
+/********************************************************************
+	@brief The number of calls to a mock since its container was
+		created (or since the test started, for CUTIE_SUITE_CONTAINER).
+
+	@param func [IN] The mocked function
+********************************************************************/
+#define MOCK_CALL_COUNT(func) (__cmock__##func.calls().count())
+
+/********************************************************************
+	@brief The time a call to a mock started, as a
+		std::chrono::steady_clock::time_point.
+		Only the first CUTIE_MOCK_CALL_LOG_SIZE calls (64 unless
+		defined otherwise) are timed. Throws std::out_of_range if there
+		was no such call, or it wasn't timed.
+
+	@param func [IN] The mocked function
+	@param index [IN] The index of the call, starting from 0
+********************************************************************/
+#define MOCK_CALL_TIME(func, index) (__cmock__##func.calls().at(index).start)
+
+/********************************************************************
+	@brief Expect a call to a mock to start within a time limit
+		after a time point.
+
+	@param func [IN] The mocked function
+	@param index [IN] The index of the call, starting from 0
+	@param since [IN] The time point, for example MOCK_CALL_TIME of another call
+	@param limit [IN] The longest time allowed, as a std::chrono::duration
+********************************************************************/
+#define EXPECT_MOCK_CALL_WITHIN(func, index, since, limit) \
+    EXPECT_TRUE(cutie::IsCallWithin(__cmock__##func.calls(), (index), (since), (limit)))
+
+/********************************************************************
+	@brief Start measuring time on the calling thread, with and
+		without the time spent inside mocks.
+		Use the stopwatch's elapsed() and elapsed_excluding_mocks().
+
+	@param name [IN] The name of the stopwatch
+********************************************************************/
+#define CUTIE_START_STOPWATCH(name) cutie::CStopwatch name
+
+/********************************************************************
+	@brief Expect a duration to be shorter than a limit.
+
+	@param duration [IN] A std::chrono::duration
+	@param limit [IN] The limit, as a std::chrono::duration
+********************************************************************/
+#define EXPECT_SHORTER_THAN(duration, limit) EXPECT_TRUE(cutie::IsShorterThan((duration), (limit)))
+
+// Pastes its arguments after expanding them, for names made unique by __LINE__
+#define CUTIE_CONCAT(first, second) CUTIE_CONCAT_EXPANDED(first, second)
+#define CUTIE_CONCAT_EXPANDED(first, second) first##second
+
+/********************************************************************
+	@brief Count the allocations made by all threads from now until
+		scope ends. Use the tracker's allocations(), bytes() and
+		frees().
+
+	@param name [IN] The name of the tracker
+********************************************************************/
+#define CUTIE_TRACK_ALLOCATIONS(name) cutie::CAllocationScope name
+
+/********************************************************************
+	@brief Fail the test if more than n allocations (calls to malloc,
+		calloc or realloc) are made from now until scope ends.
+
+	@param n [IN] The number of allocations allowed
+********************************************************************/
+#define EXPECT_MAX_ALLOCATIONS(n) \
+    cutie::CScopedAllocationBudget CUTIE_CONCAT(cutie_allocation_budget_, __LINE__)( \
+            __FILE__, __LINE__, (n), UINT64_MAX)
+
+/********************************************************************
+	@brief Fail the test if more than n bytes are allocated from now
+		until scope ends.
+
+	@param n [IN] The number of bytes allowed
+********************************************************************/
+#define EXPECT_MAX_BYTES(n) \
+    cutie::CScopedAllocationBudget CUTIE_CONCAT(cutie_bytes_budget_, __LINE__)(__FILE__, __LINE__, UINT64_MAX, (n))
+
+#endif // CUTIE_MOCK_HPP
@@ -12,7 +12,8 @@ extern "C" {
 using namespace testing;
 
 //@formatter:off
-DECLARE_HOOKABLE(sprintf); // Sadly, GMock doesn't support mocking ellipsis...
+DECLARE_HOOKABLE(sprintf);
+DECLARE_MOCKABLE_VARIADIC(snprintf, 3, vsnprintf); // Mocking ellipsis requires the v* counterpart
 DECLARE_MOCKABLE(fclose, 1);
 DECLARE_MOCKABLE(fwrite, 4);
 DECLARE_MOCKABLE(fopen, 2);
@@ -21,9 +22,8 @@ DECLARE_MOCKABLE(fopen, 2);
 int tested_function(const char* file);
 
 int __STUB__sprintf(char* str, const char* format, ...) {
-    SCOPE_REMOVE_HOOK(sprintf);
     std::cout << "I'm in stub!" << std::endl;
-    sprintf(str, "%s/%s", "foo", "bar");
+    CALL_ORIGINAL(sprintf, str, "%s/%s", "foo", "bar");
     return 10;
 }
 
@@ -44,4 +44,15 @@ TEST(Sample, Test) {
     EXPECT_EQ(11, tested_function("dummy_file"));
     EXPECT_EQ(12, tested_function("dummy_file"));
     EXPECT_EQ(13, tested_function("dummy_file"));
-}
\ No newline at end of file
+}
+
+TEST(Sample, Ellipsis) {
+    INSTALL_MOCK(snprintf);
+    CUTIE_EXPECT_CALL(snprintf, _, 20, StrEq("%s/%s"), _); // Calls vsnprintf() by default
+    CUTIE_EXPECT_CALL(snprintf, _, 10, _, _).WillOnce(Return(-1));
+
+    char s[20] = {0};
+    EXPECT_EQ(7, snprintf(s, 20, "%s/%s", "foo", "bar"));
+    EXPECT_STREQ("foo/bar", s);
+    EXPECT_EQ(-1, snprintf(s, 10, "%d", 5));
+}
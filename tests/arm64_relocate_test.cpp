@@ -0,0 +1,132 @@
+// Tests of the AArch64 trampolines of inc/subhook_arm64.hpp
+// Relocating instructions is pure logic, so these tests run on any architecture, on known instruction words.
+// Built by tests/CMakeLists.txt, like Cutie's other tests
+
+#include <cstdint>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "inc/subhook_arm64.hpp"
+
+using namespace cutie::arm64;
+
+// The address the relocated instructions were at, page aligned so ADRP is easy to follow
+static const uint64_t g_pc = 0x400000;
+
+static const uint32_t g_ldr_x16_8 = 0x58000050;     // LDR X16, #8
+static const uint32_t g_ldr_x16_12 = 0x58000070;    // LDR X16, #12
+static const uint32_t g_b_12 = 0x14000003;          // B #12
+static const uint32_t g_b_20 = 0x14000005;          // B #20
+
+// Relocates a single instruction, returning the trampoline's words, or nothing if it can't be relocated
+static std::vector<uint32_t> Relocated(uint32_t instruction, uint64_t pc = g_pc) {
+    uint32_t code[g_max_relocation_size + 2] = {};
+    CCodeWriter writer(code);
+    if (!Relocate(writer, instruction, pc)) {
+        return {};
+    }
+    return std::vector<uint32_t>(code, code + writer.size());
+}
+
+static uint32_t Low(uint64_t address) { return (uint32_t) address; }
+
+static uint32_t High(uint64_t address) { return (uint32_t) (address >> 32); }
+
+TEST(Arm64Relocate, CopiesInstructionsThatArentPcRelative) {
+    EXPECT_EQ(std::vector<uint32_t>({0xA9BF7BFD}), Relocated(0xA9BF7BFD));    // STP X29, X30, [SP, #-16]!
+    EXPECT_EQ(std::vector<uint32_t>({0x910003FD}), Relocated(0x910003FD));    // MOV X29, SP
+}
+
+TEST(Arm64Relocate, Branch) {
+    uint64_t target = g_pc + 0x10;
+    // B #0x10
+    EXPECT_EQ(std::vector<uint32_t>({g_ldr_x16_8, 0xD61F0200, Low(target), High(target)}), Relocated(0x14000004));
+}
+
+TEST(Arm64Relocate, BranchWithLinkReturnsPastTheAddress) {
+    uint64_t target = g_pc - 8;
+    // BL #-8 becomes LDR X16, #12; BLR X16; B #12; followed by the target
+    EXPECT_EQ(std::vector<uint32_t>({g_ldr_x16_12, 0xD63F0200, g_b_12, Low(target), High(target)}),
+              Relocated(0x97FFFFFE));
+}
+
+TEST(Arm64Relocate, ConditionalBranch) {
+    uint64_t target = g_pc - 4;
+    // B.NE #-4 becomes B.NE #8; B #20; followed by a jump to the target
+    EXPECT_EQ(std::vector<uint32_t>({0x54000041, g_b_20, g_ldr_x16_8, 0xD61F0200, Low(target), High(target)}),
+              Relocated(0x54FFFFE1));
+}
+
+TEST(Arm64Relocate, CompareAndBranch) {
+    uint64_t target = g_pc + 0x20;
+    // CBZ X0, #0x20
+    EXPECT_EQ(std::vector<uint32_t>({0xB4000040, g_b_20, g_ldr_x16_8, 0xD61F0200, Low(target), High(target)}),
+              Relocated(0xB4000100));
+}
+
+TEST(Arm64Relocate, TestAndBranch) {
+    uint64_t target = g_pc + 0x10;
+    // TBZ W1, #3, #0x10 keeps the tested bit
+    EXPECT_EQ(std::vector<uint32_t>({0x36180041, g_b_20, g_ldr_x16_8, 0xD61F0200, Low(target), High(target)}),
+              Relocated(0x36180081));
+}
+
+TEST(Arm64Relocate, Adr) {
+    uint64_t address = g_pc + 0x10;
+    // ADR X2, #0x10 becomes LDR X2, #8; B #12; followed by the address
+    EXPECT_EQ(std::vector<uint32_t>({0x58000042, g_b_12, Low(address), High(address)}), Relocated(0x10000082));
+}
+
+TEST(Arm64Relocate, AdrpIsRelativeToThePage) {
+    uint64_t address = g_pc + 0x2000;
+    // ADRP X3, #0x2000, from the middle of the page
+    EXPECT_EQ(std::vector<uint32_t>({0x58000043, g_b_12, Low(address), High(address)}),
+              Relocated(0xD0000003, g_pc + 0x234));
+}
+
+TEST(Arm64Relocate, LoadLiteral) {
+    uint64_t address = g_pc + 8;
+    // LDR X5, #8 becomes a load of the address into X5, then LDR X5, [X5]
+    EXPECT_EQ(std::vector<uint32_t>({0x58000045, g_b_12, Low(address), High(address), 0xF94000A5}),
+              Relocated(0x58000045));
+    // LDR W6, #4 then loads 32 bits, with LDR W6, [X6]
+    address = g_pc + 4;
+    EXPECT_EQ(std::vector<uint32_t>({0x58000046, g_b_12, Low(address), High(address), 0xB94000C6}),
+              Relocated(0x18000026));
+    // LDRSW X7, #4 then sign extends, with LDRSW X7, [X7]
+    EXPECT_EQ(std::vector<uint32_t>({0x58000047, g_b_12, Low(address), High(address), 0xB98000E7}),
+              Relocated(0x98000027));
+}
+
+TEST(Arm64Relocate, PrefetchLiteralIsDropped) {
+    // PRFM PLDL1KEEP, #8
+    EXPECT_EQ(std::vector<uint32_t>({g_nop}), Relocated(0xD8000040));
+}
+
+TEST(Arm64Relocate, SimdLoadLiteralCantBeRelocated) {
+    // LDR Q0, #8
+    EXPECT_TRUE(Relocated(0x9C000040).empty());
+}
+
+TEST(Arm64Relocate, TrampolineJumpsBackPastThePrologue) {
+    // STP X29, X30, [SP, #-16]!; MOV X29, SP; CBZ X0, #0x20; followed by the rest of the function
+    uint32_t function[8] = {0xA9BF7BFD, 0x910003FD, 0xB4000100, 0x910003FD};
+    uint64_t back = (uint64_t) (uintptr_t) &function[g_prologue_size];
+    uint64_t target = (uint64_t) (uintptr_t) &function[2] + 0x20;
+    size_t size = 0;
+    const uint32_t* trampoline = (const uint32_t*) BuildTrampoline(function, &size);
+    ASSERT_NE(nullptr, trampoline);
+
+    std::vector<uint32_t> expected = {0xA9BF7BFD, 0x910003FD,
+                                      0xB4000040, g_b_20, g_ldr_x16_8, 0xD61F0200, Low(target), High(target),
+                                      0x910003FD,
+                                      g_ldr_x16_8, 0xD61F0200, Low(back), High(back)};
+    EXPECT_EQ(expected, std::vector<uint32_t>(trampoline, trampoline + expected.size()));
+    munmap((void*) trampoline, size);
+}
+
+TEST(Arm64Relocate, NoTrampolineForAnUnrelocatablePrologue) {
+    uint32_t function[8] = {0xA9BF7BFD, 0x9C000040, 0x910003FD, 0x910003FD};
+    size_t size = 0;
+    EXPECT_EQ(nullptr, BuildTrampoline(function, &size));
+}
@@ -0,0 +1,238 @@
+// Tests of the call logs of inc/call_log.hpp, as written by CUTIE_RECORD and read by CUTIE_REPLAY
+// Built by tests/CMakeLists.txt, like Cutie's other tests
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <gtest/gtest.h>
+
+#include "inc/call_log.hpp"
+
+using namespace testing;
+using namespace cutie;
+
+// A recorded write(fd, buffer, size)
+static const std::vector<RecordedArgument> g_write_arguments = {
+        UncheckedArgument(0), InputBuffer(1, 2), {2, RecordedArgument::Value, 0}};
+
+static std::string LogPath() {
+    return TempDir() + "cutie_call_log_test." + std::to_string(getpid()) + ".log";
+}
+
+static std::vector<uint8_t> WriteRecord(int error, ssize_t result, int fd, const std::string& buffer) {
+    std::vector<uint8_t> record;
+    size_t size = buffer.size();
+    CCallLogWriter::AppendU32(record, (uint32_t) error);
+    CCallLogWriter::AppendSpan(record, &result, sizeof(result));
+    CCallLogWriter::AppendSpan(record, &fd, sizeof(fd));
+    CCallLogWriter::AppendSpan(record, buffer.data(), buffer.size());
+    CCallLogWriter::AppendSpan(record, &size, sizeof(size));
+    return record;
+}
+
+static std::string Bytes(const LogSpan& span) {
+    return std::string((const char*) span.data, span.size);
+}
+
+template<typename T>
+static T Value(const LogSpan& span) {
+    T value{};
+    EXPECT_EQ(sizeof(value), span.size);
+    std::memcpy(&value, span.data, std::min<size_t>(sizeof(value), span.size));
+    return value;
+}
+
+static void ExpectWrite(const LoggedCall& call, int error, ssize_t result, int fd, const std::string& buffer) {
+    EXPECT_EQ(error, call.error);
+    EXPECT_EQ(result, Value<ssize_t>(call.result));
+    ASSERT_EQ(3u, call.arguments.size());
+    EXPECT_EQ(fd, Value<int>(call.arguments[0]));
+    EXPECT_EQ(buffer, Bytes(call.arguments[1]));
+    EXPECT_EQ(buffer.size(), Value<size_t>(call.arguments[2]));
+}
+
+static void WriteLog(const std::string& path, const std::vector<std::vector<uint8_t>>& records) {
+    CCallLogWriter writer;
+    ASSERT_TRUE(writer.Open(path, g_write_arguments));
+    for (const std::vector<uint8_t>& record : records) {
+        writer.AppendRecord(record);
+    }
+    writer.Close();
+}
+
+static off_t FileSize(const std::string& path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    return (off_t) file.tellg();
+}
+
+class CallLog : public Test {
+protected:
+    std::string m_path = LogPath();
+
+    void TearDown() override {
+        unlink(m_path.c_str());
+    }
+};
+
+TEST_F(CallLog, RoundTrip) {
+    WriteLog(m_path, {WriteRecord(0, 5, 3, "hello"), WriteRecord(EAGAIN, -1, 4, ""), WriteRecord(0, 2, 3, "hi")});
+
+    CCallLogReader reader;
+    std::string error;
+    ASSERT_TRUE(reader.Open(m_path, &error)) << error;
+    ASSERT_EQ(3u, reader.arguments().size());
+    for (size_t i = 0; i < g_write_arguments.size(); ++i) {
+        EXPECT_EQ(i, reader.arguments()[i].argument);
+        EXPECT_EQ(g_write_arguments[i].kind, reader.arguments()[i].kind);
+        EXPECT_EQ(g_write_arguments[i].size_argument, reader.arguments()[i].size_argument);
+    }
+
+    LoggedCall call;
+    ASSERT_TRUE(reader.Next(&call));
+    ExpectWrite(call, 0, 5, 3, "hello");
+    ASSERT_TRUE(reader.Next(&call));
+    ExpectWrite(call, EAGAIN, -1, 4, "");
+    ASSERT_TRUE(reader.Next(&call));
+    ExpectWrite(call, 0, 2, 3, "hi");
+    EXPECT_FALSE(reader.Next(&call));
+    EXPECT_FALSE(reader.Next(&call));
+}
+
+TEST_F(CallLog, CloseTruncatesTheFileToTheCalls) {
+    std::vector<uint8_t> record = WriteRecord(0, 5, 3, "hello");
+    WriteLog(m_path, {record});
+
+    size_t header = sizeof(g_call_log_magic) + 2 * sizeof(uint32_t) + g_write_arguments.size() * 2 * sizeof(uint32_t);
+    EXPECT_EQ((off_t) (header + sizeof(uint32_t) + record.size()), FileSize(m_path));
+}
+
+TEST_F(CallLog, NoCalls) {
+    WriteLog(m_path, {});
+
+    CCallLogReader reader;
+    std::string error;
+    ASSERT_TRUE(reader.Open(m_path, &error)) << error;
+    LoggedCall call;
+    EXPECT_FALSE(reader.Next(&call));
+}
+
+TEST_F(CallLog, GrowsBeyondItsInitialMapping) {
+    std::string buffer(1000, 'x');
+    std::vector<std::vector<uint8_t>> records;
+    for (int i = 0; i < 200; ++i) {
+        buffer[0] = (char) ('a' + i % 26);
+        records.push_back(WriteRecord(0, i, i, buffer));
+    }
+    WriteLog(m_path, records);
+
+    CCallLogReader reader;
+    std::string error;
+    ASSERT_TRUE(reader.Open(m_path, &error)) << error;
+    LoggedCall call;
+    for (int i = 0; i < 200; ++i) {
+        ASSERT_TRUE(reader.Next(&call)) << "call " << i;
+        buffer[0] = (char) ('a' + i % 26);
+        ExpectWrite(call, 0, i, i, buffer);
+    }
+    EXPECT_FALSE(reader.Next(&call));
+}
+
+// As when the recording process crashed while appending a call
+TEST_F(CallLog, TruncatedCallIsntRead) {
+    WriteLog(m_path, {WriteRecord(0, 5, 3, "hello"), WriteRecord(0, 2, 3, "hi")});
+    off_t size = FileSize(m_path);
+
+    // Every cut through the last record leaves only the first one
+    std::vector<uint8_t> last = WriteRecord(0, 2, 3, "hi");
+    for (off_t cut = 1; cut <= (off_t) (sizeof(uint32_t) + last.size()); ++cut) {
+        WriteLog(m_path, {WriteRecord(0, 5, 3, "hello"), last});
+        ASSERT_EQ(0, truncate(m_path.c_str(), size - cut));
+
+        CCallLogReader reader;
+        std::string error;
+        ASSERT_TRUE(reader.Open(m_path, &error)) << error;
+        LoggedCall call;
+        ASSERT_TRUE(reader.Next(&call)) << "cut " << cut;
+        ExpectWrite(call, 0, 5, 3, "hello");
+        EXPECT_FALSE(reader.Next(&call)) << "cut " << cut;
+        EXPECT_FALSE(reader.Next(&call)) << "cut " << cut;
+    }
+}
+
+// As when the recording process crashed after writing a call's size, but before its bytes reached the file
+TEST_F(CallLog, CallOfZerosIsntRead) {
+    std::vector<uint8_t> last = WriteRecord(0, 2, 3, "hi");
+    WriteLog(m_path, {WriteRecord(0, 5, 3, "hello"), last});
+    {
+        std::fstream file(m_path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(FileSize(m_path) - (off_t) last.size());
+        std::vector<char> zeros(last.size(), 0);
+        file.write(zeros.data(), (std::streamsize) zeros.size());
+    }
+
+    CCallLogReader reader;
+    std::string error;
+    ASSERT_TRUE(reader.Open(m_path, &error)) << error;
+    LoggedCall call;
+    ASSERT_TRUE(reader.Next(&call));
+    ExpectWrite(call, 0, 5, 3, "hello");
+    EXPECT_FALSE(reader.Next(&call));
+}
+
+TEST_F(CallLog, RecordShorterThanItsSpans) {
+    // The record's size cuts through the buffer argument
+    std::vector<uint8_t> record = WriteRecord(0, 5, 3, "hello");
+    record.resize(record.size() - sizeof(size_t) - sizeof(uint32_t) - 2);
+    WriteLog(m_path, {record, WriteRecord(0, 2, 3, "hi")});
+
+    CCallLogReader reader;
+    std::string error;
+    ASSERT_TRUE(reader.Open(m_path, &error)) << error;
+    LoggedCall call;
+    EXPECT_FALSE(reader.Next(&call));
+}
+
+TEST_F(CallLog, TruncatedHeader) {
+    WriteLog(m_path, {});
+    ASSERT_EQ(0, truncate(m_path.c_str(), FileSize(m_path) - 2));
+
+    CCallLogReader reader;
+    std::string error;
+    EXPECT_FALSE(reader.Open(m_path, &error));
+    EXPECT_EQ(m_path + " is truncated", error);
+}
+
+TEST_F(CallLog, NotALog) {
+    std::ofstream(m_path) << "Not a call log, but long enough";
+
+    CCallLogReader reader;
+    std::string error;
+    EXPECT_FALSE(reader.Open(m_path, &error));
+    EXPECT_EQ(m_path + " isn't a call log", error);
+}
+
+TEST_F(CallLog, UnsupportedVersion) {
+    {
+        std::ofstream file(m_path, std::ios::binary);
+        uint32_t header[] = {g_call_log_version + 1, 0};
+        file.write(g_call_log_magic, sizeof(g_call_log_magic));
+        file.write((const char*) header, sizeof(header));
+    }
+
+    CCallLogReader reader;
+    std::string error;
+    EXPECT_FALSE(reader.Open(m_path, &error));
+    EXPECT_EQ(m_path + " has an unsupported version", error);
+}
+
+TEST_F(CallLog, MissingFile) {
+    CCallLogReader reader;
+    std::string error;
+    EXPECT_FALSE(reader.Open(m_path, &error));
+    EXPECT_EQ(0u, error.find("can't open " + m_path));
+}
@@ -0,0 +1,6 @@
+// The functions hooked by patch_mode_test.cpp
+// Kept in a file of their own, so the compiler can't inline them into the calling thread
+
+int patched_function(int a, int b) {
+    return a + b;
+}
@@ -0,0 +1,153 @@
+// Tests of the patch modes of inc/code_patcher.hpp: installing, replacing and removing a hook while another
+// thread keeps calling the function. The calling thread must always run either the function or one of the stubs.
+// Also tests nested hooks on the same function, removed out of order.
+// Built by tests/CMakeLists.txt, like Cutie's other tests
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <gtest/gtest.h>
+
+#include "hook.hpp"
+
+using namespace testing;
+
+extern "C" {
+int patched_function(int a, int b);
+}
+
+//@formatter:off
+DECLARE_HOOKABLE(patched_function);
+//@formatter:on
+
+// Each stop of the world waits for the calling thread to be scheduled, so fewer patches are made then
+static const int g_atomic_patches = 2000;
+static const int g_stopped_patches = 200;
+
+int __STUB__patched_function_first(int a, int b) {
+    return 100 + a + b;
+}
+
+int __STUB__patched_function_second(int a, int b) {
+    return 200 + a + b;
+}
+
+// Calls the function until stopped, counting the calls that returned something none of its versions returns
+class CCallingThread {
+private:
+    std::atomic<bool> m_stop;
+    std::atomic<size_t> m_calls;
+    std::atomic<size_t> m_unexpected;
+    std::thread m_thread;
+
+public:
+    CCallingThread() : m_stop(false), m_calls(0), m_unexpected(0), m_thread([this]() { Run(); }) {
+        // Patch while the thread is calling, not before it started
+        while (0 == m_calls.load()) {
+            std::this_thread::yield();
+        }
+    }
+
+    ~CCallingThread() {
+        Stop();
+    }
+
+    void Stop() {
+        m_stop.store(true);
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+    }
+
+    size_t calls() const { return m_calls.load(); }
+
+    size_t unexpected() const { return m_unexpected.load(); }
+
+private:
+    void Run() {
+        // Through a volatile pointer, so every iteration calls the function
+        int (* volatile function)(int, int) = patched_function;
+        while (!m_stop.load(std::memory_order_relaxed)) {
+            int result = function(1, 2);
+            if ((3 != result) && (103 != result) && (203 != result)) {
+                m_unexpected.fetch_add(1, std::memory_order_relaxed);
+            }
+            m_calls.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+};
+
+static void PatchWhileCalled(int patches) {
+    CCallingThread thread;
+    for (int i = 0; i < patches; ++i) {
+        INSTALL_HOOK(patched_function, __STUB__patched_function_first);
+        REPLACE_HOOK(patched_function, __STUB__patched_function_second);
+    }
+    size_t calls = thread.calls();
+    thread.Stop();
+
+    EXPECT_EQ(0u, thread.unexpected()) << "of " << calls << " calls";
+    EXPECT_EQ(3, patched_function(1, 2));
+}
+
+class PatchModes : public Test {
+protected:
+    void TearDown() override {
+        CUTIE_SET_PATCH_MODE(Plain);
+    }
+};
+
+TEST_F(PatchModes, AtomicWhileAnotherThreadCalls) {
+    CUTIE_SET_PATCH_MODE(Atomic);
+    PatchWhileCalled(g_atomic_patches);
+}
+
+TEST_F(PatchModes, StopTheWorldWhileAnotherThreadCalls) {
+    CUTIE_SET_PATCH_MODE(StopTheWorld);
+    PatchWhileCalled(g_stopped_patches);
+}
+
+TEST_F(PatchModes, HookSetWhileAnotherThreadCalls) {
+    CUTIE_SET_PATCH_MODE(StopTheWorld);
+    CCallingThread thread;
+    for (int i = 0; i < g_stopped_patches; ++i) {
+        DECLARE_HOOK_SET(hooks);
+        HOOK_SET_ADD(hooks, patched_function, __STUB__patched_function_first);
+        HOOK_SET_INSTALL(hooks);
+        EXPECT_EQ(103, patched_function(1, 2));
+    }
+    thread.Stop();
+
+    EXPECT_EQ(0u, thread.unexpected());
+    EXPECT_EQ(3, patched_function(1, 2));
+}
+
+TEST(NestedHooks, OlderHookRemovedFirst) {
+    subhook_t first_hook = nullptr;
+    subhook_t second_hook = nullptr;
+    std::unique_ptr<cutie::CScopedHookInstall> first(new cutie::CScopedHookInstall(
+            &first_hook, (void*) patched_function, (void*) __STUB__patched_function_first));
+    std::unique_ptr<cutie::CScopedHookInstall> second(new cutie::CScopedHookInstall(
+            &second_hook, (void*) patched_function, (void*) __STUB__patched_function_second));
+    EXPECT_EQ(203, patched_function(1, 2));
+
+    // The newer hook stays installed, and restores the function once removed
+    first.reset();
+    EXPECT_EQ(203, patched_function(1, 2));
+    second.reset();
+    EXPECT_EQ(3, patched_function(1, 2));
+}
+
+TEST(NestedHooks, OlderHookReplacedUnderANewerOne) {
+    subhook_t first_hook = nullptr;
+    subhook_t second_hook = nullptr;
+    cutie::CScopedHookInstall first(&first_hook, (void*) patched_function, (void*) __STUB__patched_function_first);
+    {
+        cutie::CScopedHookInstall second(&second_hook, (void*) patched_function, (void*) __STUB__patched_function_second);
+        first.Replace((void*) __STUB__patched_function_second);
+        first.Replace((void*) __STUB__patched_function_first);
+        second.Replace((void*) __STUB__patched_function_second);
+        EXPECT_EQ(203, patched_function(1, 2));
+    }
+    EXPECT_EQ(103, patched_function(1, 2));
+}